@@ -4,6 +4,7 @@
 #include <iostream>
 #include <Eigen/Dense>
 #include <random>
+#include "philox.hh"
 
 namespace nqs{
 
@@ -19,7 +20,7 @@ template<class RbmState> class Gibbs{
   //number of hidden units
   const int nh_;
 
-  std::mt19937 rgen_;
+  Philox rgen_;
 
   RbmState & rbm_;
 
@@ -32,12 +33,20 @@ template<class RbmState> class Gibbs{
   VectorXd probv_;
   VectorXd probh_;
 
+  //buffer of uniform random numbers
+  VectorXd uniforms_;
+
 public:
   
-  Gibbs(RbmState & rbm):rbm_(rbm),nv_(rbm.Nvisible()),nh_(rbm.Nhidden()){
+  //seed<0 takes the seed from std::random_device
+  //chain identifies the random stream, for several samplers with the same seed
+  Gibbs(RbmState & rbm,int seed=-1,int chain=0):rbm_(rbm),nv_(rbm.Nvisible()),nh_(rbm.Nhidden()){
 
-    std::random_device rd;
-    rgen_.seed(rd());
+    if(seed<0){
+      std::random_device rd;
+      seed=rd()>>1;
+    }
+    rgen_.Seed(seed,chain,Philox::kGibbs);
 
     v_.resize(nv_); 
     h_.resize(nh_); 
@@ -45,6 +54,8 @@ public:
     probv_.resize(nv_);   
     probh_.resize(nh_);   
 
+    uniforms_.resize(std::max(nv_,nh_));
+
     RandomVals(v_);  
 
     cout<<"# Gibbs sampler is ready "<<endl;
@@ -86,23 +97,20 @@ public:
   }
 
   void RandomVals(VectorXd & hv){   
-    std::uniform_int_distribution<int> distribution(0,1);
-
     for(int i=0;i<hv.size();i++){
-      hv(i)=distribution(rgen_);
+      hv(i)=rgen_.Index(2);
     }
   }
 
   int RandomVisible(){
-    std::uniform_int_distribution<int> distribution(0,nv_);
-    return distribution(rgen_);
+    return rgen_.Index(nv_);
   }
 
   void RandomValsWithProb(VectorXd & hv,const VectorXd & probs){  
-    std::uniform_real_distribution<double> distribution(0,1);
+    rgen_.FillUniform(uniforms_.data(),hv.size());
 
     for(int i=0;i<hv.size();i++){
-      hv(i)=distribution(rgen_)<probs(i);
+      hv(i)=uniforms_(i)<probs(i);
     } 
   }
 
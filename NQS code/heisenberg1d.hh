@@ -0,0 +1,78 @@
+#ifndef NQS_HEISENBERG1D_HH
+#define NQS_HEISENBERG1D_HH
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <random>
+#include <complex>
+#include <vector>
+
+namespace nqs{
+
+using namespace std;
+using namespace Eigen;
+
+//Anti-ferromagnetic Heisenberg model in 1D
+//With periodic boundary conditons
+//H=\sum_i [Jz*\sigma^z_i*\sigma^z_{i+1} - 2*(\sigma^+_i*\sigma^-_{i+1} + h.c.)]
+//The sign of the exchange term is obtained with the Marshall rotation (for an even number of spins),
+//so that the ground state is positive and can be represented by a real Rbm
+//The hamiltonian conserves the magnetization, and must be sampled with a fixed number of up spins
+
+class Heisenberg1d{
+
+  //Number of spins
+  const int nspins_;
+
+  //Longitudinal coupling constant
+  double Jz_;
+
+public:
+
+  Heisenberg1d(int nspins,double Jz=1):nspins_(nspins),Jz_(Jz){
+  }
+
+
+  //Finds the connected elements of the Hamiltonians
+  //i.e. all the X'(k) such that H(X,X'(k))\neq0
+  //for this model k=0 is the diagonal element X'(0)=X,
+  //and the other X'(k) exchange two antiparallel nearest neighbours
+  //input is:
+  //X(i), a binary vector containing the state X
+  //output is:
+  //mel(k), matrix elements H(X,X'(k))
+  //connector(k), for each k contains a list of spins that should be flipped to obtain X'(k)
+  //starting from X
+  void FindConn(const VectorXd & X,vector<double> & mel,vector<vector<int> > & connectors){
+
+    connectors.clear();
+    connectors.resize(1);
+    mel.resize(1);
+
+    mel[0]=0;
+    connectors[0].resize(0);
+
+    for(int i=0;i<nspins_;i++){
+      const int j=(i+1)%nspins_;
+
+      mel[0]+=Jz_*(2*X(i)-1.)*(2.*X(j)-1.);
+
+      if(X(i)!=X(j)){
+        mel.push_back(-2);
+        connectors.push_back(vector<int>({i,j}));
+      }
+    }
+
+  }
+
+  //number of up spins of the sector of the ground state
+  int Nup()const{
+    return nspins_/2;
+  }
+
+};
+
+
+}
+
+#endif
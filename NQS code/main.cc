@@ -1,40 +1,80 @@
 #pragma GCC diagnostic error "-std=c++11"
 #include <iostream>
+#include <string>
 #include "nqs.hh"
 
 using namespace std;
 using namespace nqs;
 
-int main(){
+//Optimizes the Rbm sampled by the given sampler
+template<class Hamiltonian,class Sampler> void Optimize(Hamiltonian & hamiltonian,Sampler & sampler){
 
-  int nspins=20;
+  //Using a simple Stochastic Gradient Descent optimizer
+  typedef Sgd Optimizer;
+  double eta=0.2;
+  Sgd opt(eta);
+
+  Variational<Hamiltonian,Rbm,Sampler,Optimizer> var(hamiltonian,sampler,opt);
+
+  int batch_size=100;
+  int max_iter=10000000;
+  var.Run(batch_size,max_iter);
+}
+
+//usage: main [ising|heisenberg] [gibbs|metropolis]
+//the Heisenberg model conserves the magnetization, and is sampled with Metropolis exchanges at zero magnetization
+int main(int argc,char * argv[]){
 
-  typedef Ising1d Hamiltonian;
-  double h_field=1;
-  double Jz=1;
-  Hamiltonian hamiltonian(nspins,h_field,Jz);
+  string model=(argc>1)?argv[1]:"ising";
+  string samplername=(argc>2)?argv[2]:"gibbs";
+
+  if(model!="ising" && model!="heisenberg"){
+    cerr<<"# Error : Unknown model "<<model<<endl;
+    return 1;
+  }
+  if(samplername!="gibbs" && samplername!="metropolis"){
+    cerr<<"# Error : Unknown sampler "<<samplername<<endl;
+    return 1;
+  }
+  if(model=="heisenberg" && samplername=="gibbs"){
+    cerr<<"# Error : The Heisenberg model must be sampled at fixed magnetization, with the metropolis sampler"<<endl;
+    return 1;
+  }
+
+  int nspins=20;
 
   //Defining the Rbm State
   typedef Rbm RbmState;
   int nhidden=20;
-  RbmState rbm(nspins,nhidden);   
+  RbmState rbm(nspins,nhidden);
 
   int seed=12345;
-  rbm.InitRandomPars(seed,0.01); 
+  rbm.InitRandomPars(seed,0.01);
 
-  //The Gibbs sampler
-  typedef Gibbs<RbmState> Sampler;
-  Sampler sampler(rbm);
+  if(model=="ising"){
+    double h_field=1;
+    double Jz=1;
+    Ising1d hamiltonian(nspins,h_field,Jz);
 
-  //Using a simple Stochastic Gradient Descent optimizer
-  typedef Sgd Optimizer;
-  double eta=0.2;   
-  Sgd opt(eta);
-
-  Variational<Hamiltonian,RbmState,Sampler,Optimizer> var(hamiltonian,sampler,opt);  
+    if(samplername=="gibbs"){
+      //The Gibbs sampler
+      Gibbs<RbmState> sampler(rbm);
+      Optimize(hamiltonian,sampler);
+    }
+    else{
+      //The local Metropolis sampler, with single flips
+      Metropolis<RbmState> sampler(rbm,seed);
+      Optimize(hamiltonian,sampler);
+    }
+  }
+  else{
+    double Jz=1;
+    Heisenberg1d hamiltonian(nspins,Jz);
 
-  int batch_size=100;
-  int max_iter=10000000;  
-  var.Run(batch_size,max_iter);
+    //The local Metropolis sampler, with exchanges at fixed magnetization
+    Metropolis<RbmState> sampler(rbm,seed);
+    sampler.SetMagnetization(hamiltonian.Nup());
+    Optimize(hamiltonian,sampler);
+  }
 
 }
@@ -0,0 +1,232 @@
+#ifndef NQS_METROPOLIS_HH
+#define NQS_METROPOLIS_HH
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <random>
+#include <vector>
+#include "philox.hh"
+
+namespace nqs{
+
+using namespace std;
+using namespace Eigen;
+
+//Local Metropolis sampling of the visible units of binary Restricted Boltzman Machines
+//Moves flip one visible unit, or exchange a pair of units with different values,
+//and the activations of the hidden units are updated with the rows of the flipped units,
+//so each proposal costs O(nhidden) instead of the O(nvisible*nhidden) of a Gibbs sweep
+//With a fixed magnetization (number of units equal to 1) only exchanges are proposed
+template<class RbmState> class Metropolis{
+
+  RbmState & rbm_;
+
+  //number of visible units
+  const int nv_;
+
+  //number of hidden units
+  const int nh_;
+
+  Philox rgen_;
+
+  //state of the visible units
+  VectorXd v_;
+
+  //activations of the hidden units and their log(1+e^x), for the current and the proposed state
+  VectorXd thetas_;
+  VectorXd lnthetas_;
+  VectorXd thetasnew_;
+  VectorXd lnthetasnew_;
+
+  //number of visible units equal to 1, if constrained (otherwise -1)
+  int nup_;
+
+  //fraction of pair exchanges among the proposed moves, when the magnetization is free
+  double pairfraction_;
+
+  //positions of the units equal to 1 and 0, and index of each unit in its set
+  vector<int> ones_;
+  vector<int> zeros_;
+  vector<int> setpos_;
+
+  vector<int> flips_;
+
+  //accepted and proposed single flips and pair exchanges
+  double accepted_[2];
+  double proposed_[2];
+
+public:
+
+  //seed<0 takes the seed from std::random_device
+  //chain identifies the random stream, for several samplers with the same seed
+  Metropolis(RbmState & rbm,int seed=-1,int chain=0):rbm_(rbm),nv_(rbm.Nvisible()),nh_(rbm.Nhidden()){
+
+    if(seed<0){
+      std::random_device rd;
+      seed=rd()>>1;
+    }
+    rgen_.Seed(seed,chain,Philox::kSampler);
+
+    v_.resize(nv_);
+    thetas_.resize(nh_);
+    lnthetas_.resize(nh_);
+    thetasnew_.resize(nh_);
+    lnthetasnew_.resize(nh_);
+
+    nup_=-1;
+    pairfraction_=0;
+
+    Reset(true);
+
+    cout<<"# Metropolis sampler is ready "<<endl;
+  }
+
+  //fixes the number of visible units equal to 1 (nup<0 removes the constraint)
+  //the sampler is then reset to a random state with the given magnetization
+  void SetMagnetization(int nup){
+    if(nup>nv_){
+      cerr<<"# Error : The number of up spins cannot exceed the number of visible units"<<endl;
+      std::abort();
+    }
+    nup_=nup;
+    Reset(true);
+  }
+
+  //fraction of pair exchanges proposed when the magnetization is free
+  void SetPairFraction(double pairfraction){
+    pairfraction_=pairfraction;
+  }
+
+  //the activations are recomputed, since the parameters may have changed since the last sweep
+  void Reset(bool initrandom=false){
+    if(initrandom){
+      RandomVals(v_);
+    }
+
+    InitSets();
+
+    rbm_.Thetas(v_,thetas_);
+    rbm_.ln1pexp(thetas_,lnthetas_);
+
+    accepted_[0]=accepted_[1]=0;
+    proposed_[0]=proposed_[1]=0;
+  }
+
+  //nvisible proposed moves
+  void Sweep(){
+    for(int i=0;i<nv_;i++){
+      Move();
+    }
+  }
+
+  void Move(){
+    const bool pair=(nup_>=0) || (rgen_.Uniform()<pairfraction_);
+    if(pair){
+      //exchange of a unit equal to 1 with a unit equal to 0
+      if(ones_.size()==0 || zeros_.size()==0){
+        return;
+      }
+      flips_.resize(2);
+      flips_[0]=ones_[rgen_.Index(ones_.size())];
+      flips_[1]=zeros_[rgen_.Index(zeros_.size())];
+    }
+    else{
+      flips_.resize(1);
+      flips_[0]=rgen_.Index(nv_);
+    }
+
+    const double logvaldiff=rbm_.LogValDiff(v_,thetas_,lnthetas_,flips_,thetasnew_,lnthetasnew_);
+
+    proposed_[pair]+=1;
+    if(logvaldiff>=0 || std::exp(logvaldiff)>rgen_.Uniform()){
+      accepted_[pair]+=1;
+
+      for(const auto & sf : flips_){
+        v_(sf)=1.-v_(sf);
+      }
+      UpdateSets();
+
+      thetas_.swap(thetasnew_);
+      lnthetas_.swap(lnthetasnew_);
+    }
+  }
+
+  VectorXd Visible(){
+    return v_;
+  }
+
+  void SetVisible(const VectorXd & v){
+    v_=v;
+    Reset();
+  }
+
+  RbmState & Rbm(){
+    return rbm_;
+  }
+
+  //acceptance rates of single flips and of pair exchanges since the last reset
+  VectorXd Acceptance()const{
+    VectorXd acc(2);
+    for(int k=0;k<2;k++){
+      acc(k)=(proposed_[k]>0)?(accepted_[k]/proposed_[k]):0.;
+    }
+    return acc;
+  }
+
+private:
+
+  //random values of the visible units, with nup_ units equal to 1 if the magnetization is fixed
+  void RandomVals(VectorXd & hv){
+    if(nup_<0){
+      for(int i=0;i<hv.size();i++){
+        hv(i)=rgen_.Index(2);
+      }
+      return;
+    }
+
+    vector<int> perm(hv.size());
+    for(int i=0;i<hv.size();i++){
+      perm[i]=i;
+    }
+    for(int i=hv.size()-1;i>0;i--){
+      std::swap(perm[i],perm[rgen_.Index(i+1)]);
+    }
+    hv.setZero();
+    for(int i=0;i<nup_;i++){
+      hv(perm[i])=1;
+    }
+  }
+
+  void InitSets(){
+    ones_.clear();
+    zeros_.clear();
+    setpos_.resize(nv_);
+    for(int i=0;i<nv_;i++){
+      vector<int> & set=(v_(i)>0.5)?ones_:zeros_;
+      setpos_[i]=set.size();
+      set.push_back(i);
+    }
+  }
+
+  //moves the flipped units between the two sets
+  void UpdateSets(){
+    for(const auto & sf : flips_){
+      vector<int> & from=(v_(sf)>0.5)?zeros_:ones_;
+      vector<int> & to=(v_(sf)>0.5)?ones_:zeros_;
+
+      const int pos=setpos_[sf];
+      from[pos]=from.back();
+      setpos_[from[pos]]=pos;
+      from.pop_back();
+
+      setpos_[sf]=to.size();
+      to.push_back(sf);
+    }
+  }
+
+};
+
+
+}
+
+#endif
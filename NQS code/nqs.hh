@@ -1,6 +1,8 @@
 #include "rbm.hh"
 #include "ising1d.hh"
+#include "heisenberg1d.hh"
 #include "variational.hh"
 #include "sgd.hh"
 #include "gibbs.hh"
+#include "metropolis.hh"
 
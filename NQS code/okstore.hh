@@ -0,0 +1,113 @@
+#ifndef NQS_OKSTORE_HH
+#define NQS_OKSTORE_HH
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <cassert>
+
+namespace nqs{
+
+using namespace std;
+using namespace Eigen;
+
+//Structure-aware storage of the log-derivatives O_k(v) of a Rbm over a set of samples
+//For a Rbm O = (v, sigma, v sigma^T), with sigma the hidden activation probabilities,
+//so only v and sigma are kept for each sample (nsamp*(nv+nh) numbers instead of nsamp*npar)
+//and the products with the centred matrix O_ik - <O_k> are rebuilt on the fly
+class OkStore{
+
+  int nv_;
+  int nh_;
+  int npar_;
+
+  //visible samples and hidden activation probabilities, one row per sample
+  MatrixXd vsamp_;
+  MatrixXd sigmas_;
+
+  //averages of the log-derivatives
+  VectorXd okmean_;
+
+  //auxiliary variables
+  VectorXd dots_;
+  MatrixXd vw_;
+
+public:
+
+  OkStore():nv_(0),nh_(0),npar_(0){}
+
+  void Resize(int nsamp,int nv,int nh){
+    nv_=nv;
+    nh_=nh;
+    npar_=nv_+nh_+nv_*nh_;
+    vsamp_.resize(nsamp,nv_);
+    sigmas_.resize(nsamp,nh_);
+    okmean_.resize(npar_);
+  }
+
+  int Nsamples()const{
+    return vsamp_.rows();
+  }
+
+  int Npar()const{
+    return npar_;
+  }
+
+  void SetRow(int i,const VectorXd & v,const VectorXd & sigma){
+    vsamp_.row(i)=v;
+    sigmas_.row(i)=sigma;
+  }
+
+  //computes the averages of the log-derivatives, to be called once all the rows are set
+  void Finalize(){
+    const double nsamp=double(Nsamples());
+
+    okmean_.head(nv_)=vsamp_.colwise().sum().transpose()/nsamp;
+    okmean_.segment(nv_,nh_)=sigmas_.colwise().sum().transpose()/nsamp;
+
+    Map<Matrix<double,Dynamic,Dynamic,RowMajor> > mw(okmean_.data()+nv_+nh_,nv_,nh_);
+    mw=vsamp_.transpose()*sigmas_/nsamp;
+  }
+
+  const VectorXd & OkMean()const{
+    return okmean_;
+  }
+
+  //y = (1/nsamp) sum_i e_i (O_i - <O>)
+  void ApplyOkT(const VectorXd & e,VectorXd & y){
+    assert(e.size()==Nsamples());
+    const double nsamp=double(Nsamples());
+
+    y.resize(npar_);
+    y.head(nv_)=vsamp_.transpose()*e/nsamp;
+    y.segment(nv_,nh_)=sigmas_.transpose()*e/nsamp;
+
+    Map<Matrix<double,Dynamic,Dynamic,RowMajor> > yw(y.data()+nv_+nh_,nv_,nh_);
+    yw=vsamp_.transpose()*(e.asDiagonal()*sigmas_)/nsamp;
+
+    y-=okmean_*(e.sum()/nsamp);
+  }
+
+  //dots_i = (O_i - <O>) . x
+  void ApplyOk(const VectorXd & x,VectorXd & dots){
+    assert(x.size()==npar_);
+
+    Map<const Matrix<double,Dynamic,Dynamic,RowMajor> > xw(x.data()+nv_+nh_,nv_,nh_);
+    vw_=vsamp_*xw;
+
+    dots=vsamp_*x.head(nv_)+sigmas_*x.segment(nv_,nh_);
+    dots+=vw_.cwiseProduct(sigmas_).rowwise().sum();
+    dots.array()-=okmean_.dot(x);
+  }
+
+  //y = S x, with S the covariance matrix of the log-derivatives used by the Stochastic Reconfiguration
+  void ApplyS(const VectorXd & x,VectorXd & y){
+    ApplyOk(x,dots_);
+    ApplyOkT(dots_,y);
+  }
+
+};
+
+
+}
+
+#endif
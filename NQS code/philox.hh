@@ -0,0 +1,137 @@
+#ifndef NQS_PHILOX_HH
+#define NQS_PHILOX_HH
+
+#include <cstdint>
+#include <ctime>
+
+namespace nqs{
+
+//Counter-based pseudo-random number generator (Philox4x32-10, Salmon et al. SC11)
+//The stream is identified by (seed, chain, purpose): different chains or different uses
+//(e.g. Metropolis moves and dropout) get independent streams without sharing any state,
+//so that results do not depend on how chains are assigned to threads
+//Random numbers are generated in blocks, with loops over independent counters that the compiler can vectorize
+class Philox{
+
+  //number of 4x32 blocks generated at once
+  static const int nblocks_=16;
+
+  //key
+  uint32_t k0_;
+  uint32_t k1_;
+
+  //stream identifiers, stored in the high words of the counter
+  uint32_t chain_;
+  uint32_t purpose_;
+
+  //index of the next block to be generated
+  uint64_t counter_;
+
+  //buffer of generated numbers
+  uint32_t buffer_[4*nblocks_];
+  int pos_;
+
+public:
+
+  //identifiers of the different uses of random numbers
+  enum Purpose{kSampler=0,kGibbs=1,kDropout=2,kInit=3};
+
+  Philox(uint64_t seed=0,uint32_t chain=0,uint32_t purpose=0){
+    Seed(seed,chain,purpose);
+  }
+
+  void Seed(uint64_t seed,uint32_t chain=0,uint32_t purpose=0){
+    k0_=uint32_t(seed);
+    k1_=uint32_t(seed>>32);
+    chain_=chain;
+    purpose_=purpose;
+    counter_=0;
+    pos_=4*nblocks_;
+  }
+
+  //seed taken from the internal clock
+  void SeedFromClock(uint32_t chain=0,uint32_t purpose=0){
+    Seed(uint64_t(std::time(nullptr)),chain,purpose);
+  }
+
+  //32 random bits
+  inline uint32_t Next(){
+    if(pos_==4*nblocks_){
+      Refill();
+    }
+    return buffer_[pos_++];
+  }
+
+  //Uniform random number in [0,1)
+  inline double Uniform(){
+    return double(Next())*2.3283064365386962890625e-10;
+  }
+
+  //Uniform random integer in [0,n)
+  inline int Index(int n){
+    return int((uint64_t(Next())*uint64_t(n))>>32);
+  }
+
+  //n uniform random numbers in [0,1)
+  void FillUniform(double * out,int n){
+    for(int i=0;i<n;i++){
+      out[i]=Uniform();
+    }
+  }
+
+private:
+
+  void Refill(){
+    uint32_t c0[nblocks_],c1[nblocks_],c2[nblocks_],c3[nblocks_];
+
+    for(int b=0;b<nblocks_;b++){
+      const uint64_t ctr=counter_+b;
+      c0[b]=uint32_t(ctr);
+      c1[b]=uint32_t(ctr>>32);
+      c2[b]=chain_;
+      c3[b]=purpose_;
+    }
+    counter_+=nblocks_;
+
+    Rounds(c0,c1,c2,c3,nblocks_,k0_,k1_);
+
+    for(int b=0;b<nblocks_;b++){
+      buffer_[4*b]=c0[b];
+      buffer_[4*b+1]=c1[b];
+      buffer_[4*b+2]=c2[b];
+      buffer_[4*b+3]=c3[b];
+    }
+    pos_=0;
+  }
+
+  //ten Philox rounds on n counters stored as separate arrays of words
+  static void Rounds(uint32_t * c0,uint32_t * c1,uint32_t * c2,uint32_t * c3,int n,uint32_t k0,uint32_t k1){
+    const uint32_t m0=0xD2511F53u;
+    const uint32_t m1=0xCD9E8D57u;
+    const uint32_t w0=0x9E3779B9u;
+    const uint32_t w1=0xBB67AE85u;
+
+    for(int r=0;r<10;r++){
+      for(int b=0;b<n;b++){
+        const uint64_t p0=uint64_t(m0)*c0[b];
+        const uint64_t p1=uint64_t(m1)*c2[b];
+        const uint32_t x0=uint32_t(p1>>32)^c1[b]^k0;
+        const uint32_t x1=uint32_t(p1);
+        const uint32_t x2=uint32_t(p0>>32)^c3[b]^k1;
+        const uint32_t x3=uint32_t(p0);
+        c0[b]=x0;
+        c1[b]=x1;
+        c2[b]=x2;
+        c3[b]=x3;
+      }
+      k0+=w0;
+      k1+=w1;
+    }
+  }
+
+};
+
+
+}
+
+#endif
@@ -94,25 +94,31 @@ public:
 
   VectorXd DerLog(const VectorXd & v){ 
     VectorXd der(npar_); 
+    DerLog(v,der.data());
+    return der;  
+  }
 
+  //Log-derivatives written into npar contiguous elements, without allocations
+  void DerLog(const VectorXd & v,double * der){
     for(int k=0;k<nv_;k++){  
-      der(k)=v(k);
+      der[k]=v(k);
     }
 
-    logistic(W_.transpose()*v+b_,lnthetas_);  
+    thetas_.noalias()=W_.transpose()*v;
+    thetas_+=b_;
+    logistic(thetas_,lnthetas_);  
 
     for(int k=nv_;k<(nv_+nh_);k++){  
-      der(k)=lnthetas_(k-nv_);   
+      der[k]=lnthetas_(k-nv_);   
     }
 
     int k=nv_+nh_; 
     for(int i=0;i<nv_;i++){
       for(int j=0;j<nh_;j++){
-        der(k)=lnthetas_(j)*v(i);
+        der[k]=lnthetas_(j)*v(i);
         k++;
       }
     }
-    return der;  
   }
 
   VectorXd GetParameters(){  
@@ -202,6 +208,34 @@ public:
   }
 
 
+  //Values of the hidden units activations W^T v + b
+  void Thetas(const VectorXd & v,VectorXd & thetas)const{
+    thetas.noalias()=W_.transpose()*v;
+    thetas+=b_;
+  }
+
+  //Difference between logarithms of values when the visible units in "toflip" are flipped,
+  //given the activations (thetas) of v and their log(1+e^x) (lnthetas)
+  //the activations of the new configuration are written in thetasnew and lnthetasnew
+  //only the rows of W_ corresponding to the flipped units are used
+  double LogValDiff(const VectorXd & v,const VectorXd & thetas,const VectorXd & lnthetas,
+                    const vector<int> & toflip,VectorXd & thetasnew,VectorXd & lnthetasnew)const{
+    double logvaldiff=0;
+
+    thetasnew=thetas;
+    for(const auto & sf : toflip){
+      const double delta=1.-2.*v(sf);
+      logvaldiff+=a_(sf)*delta;
+      thetasnew+=delta*W_.row(sf).transpose();
+    }
+
+    for(int j=0;j<nh_;j++){
+      lnthetasnew(j)=ln1pexp(thetasnew(j));
+      logvaldiff+=lnthetasnew(j)-lnthetas(j);
+    }
+    return logvaldiff;
+  }
+
   void logistic(const VectorXd & x,VectorXd & y){  
     for(int i=0;i<x.size();i++){ 
       y(i)=logistic(x(i));    
@@ -212,7 +246,7 @@ public:
     return 1./(1.+std::exp(-x));
   }
 
-  void ln1pexp(const VectorXd & x,VectorXd & y){  
+  void ln1pexp(const VectorXd & x,VectorXd & y)const{  
     for(int i=0;i<x.size();i++){
       y(i)=ln1pexp(x(i));
     }
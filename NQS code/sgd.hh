@@ -6,6 +6,7 @@
 #include <Eigen/Dense>
 #include <cassert>
 #include <cmath>
+#include "philox.hh"
 
 namespace nqs{
 
@@ -25,24 +26,36 @@ class Sgd{
 
   double momentum_;
 
-  std::mt19937 rgen_;
+  Philox rgen_;
+
+  //uniform random numbers used for dropout
+  VectorXd uniforms_;
 
 public:
        //eta = 0.2
-  Sgd(double eta,double momentum=0,double l2reg=0,double dropout_p=0):eta_(eta),l2reg_(l2reg),dropout_p_(dropout_p),momentum_(momentum){
+  Sgd(double eta,double momentum=0,double l2reg=0,double dropout_p=0,int seed=0):eta_(eta),l2reg_(l2reg),dropout_p_(dropout_p),momentum_(momentum),rgen_(seed,0,Philox::kDropout){
     npar_=-1;
   }
 
   void SetNpar(int npar){  
     npar_=npar;
+    uniforms_.resize(npar_);
   }
 
   void Update(const VectorXd & grad,VectorXd & pars){ 
     assert(npar_>0);
 
-    std::uniform_real_distribution<double> distribution(0,1);
+    //without dropout every parameter is updated and no random numbers are drawn
+    if(dropout_p_<=0){
+      for(int i=0;i<npar_;i++){
+        pars(i)=(1.-momentum_)*pars(i) - (grad(i)+l2reg_*pars(i))*eta_;
+      }
+      return;
+    }
+
+    rgen_.FillUniform(uniforms_.data(),npar_);
     for(int i=0;i<npar_;i++){
-      if(distribution(rgen_)>dropout_p_){  
+      if(uniforms_(i)>dropout_p_){  
         pars(i)=(1.-momentum_)*pars(i) - (grad(i)+l2reg_*pars(i))*eta_;  
       }  
     }
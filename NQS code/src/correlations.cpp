@@ -0,0 +1,387 @@
+//
+//  correlations.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <algorithm>
+#include "nqs_paper.h"
+
+//Spin structure factor and two-point correlation functions on periodic chains (dim=1) and square lattices (dim=2)
+//S(q) = <|sigma_q|^2>/N with sigma_q = sum_j sigma^z_j exp(-i q.j), and Czz(r) = sum_j <sigma^z_j sigma^z_{j+r}>/N,
+//obtained from S(q) with the inverse transform
+//All the momenta of a sample are given by one FFT, in O(N log N) operations: since the configurations are real,
+//two consecutive samples are packed in the real and imaginary parts of a single complex transform
+//The off-diagonal correlations C+-(r) = sum_j <sigma^+_j sigma^-_{j+r} + h.c.>/N are optional, since they need
+//the ratios Psi(s')/Psi(s) of all the exchanges of antiparallel spins, evaluated together with LogPoPMulti
+//Optionally Czz(r) and S(q) are also measured with the waste-recycling estimator: every proposal s -> s' of the
+//sweep contributes (1-a) Czz(r;s) + a Czz(r;s'), with a the acceptance probability of the move, and S(q) is
+//the transform of the recycled Czz(r) of each sweep. The change of Czz(r) under a proposal needs O(N) operations
+//for all the distances, and no evaluations of the network
+template<class Hamiltonian> class Correlations{
+
+    Nqs & wf_;
+
+    Hamiltonian & hamiltonian_;
+
+    //linear size and dimension of the lattice
+    const int l_;
+    const int dim_;
+    const int nsites_;
+
+    Fft fft_;
+
+    //measure of C+-(r)
+    const bool offdiagonal_;
+
+    //averages for each momentum and distance (site index of q and r as in Fft)
+    std::vector<StreamingBinning> sq_;
+    std::vector<StreamingBinning> czz_;
+    std::vector<StreamingBinning> cpm_;
+
+    //sample waiting to be packed with the next one
+    std::vector<double> pending_;
+    bool haspending_;
+
+    std::vector<std::complex<double> > z_;
+    std::vector<std::complex<double> > p_;
+    std::vector<std::complex<double> > logpops_;
+    std::vector<std::complex<double> > cpmsample_;
+
+    //buffer of the antiparallel pairs of a sample, with room for all the N(N-1)/2 pairs,
+    //so that no memory is allocated during the sampling
+    std::vector<std::vector<int> > pairs_;
+
+    //waste-recycling estimator of Czz(r) and S(q)
+    //czzstate_ is the sum_j s_j s_{j+r} of the state recstate_, which is updated when the last proposal,
+    //with change czzdelta_, is found accepted; czzsweep_ accumulates the recycled sums of the moves of a sweep
+    const bool recycle_;
+    std::vector<StreamingBinning> sqrec_;
+    std::vector<StreamingBinning> czzrec_;
+    std::vector<int> recstate_;
+    std::vector<double> czzstate_;
+    std::vector<double> czzdelta_;
+    std::vector<double> czzsweep_;
+    std::vector<int> lastflips_;
+    std::vector<int> jpairs_;
+    double nproposals_;
+
+public:
+
+    Correlations(Nqs & wf,Hamiltonian & hamiltonian,int dim,bool offdiagonal,bool recycle=false):
+    wf_(wf),hamiltonian_(hamiltonian),l_(LinearSize(wf.Nspins(),dim)),dim_(dim),nsites_(wf.Nspins()),
+    fft_(l_,dim),offdiagonal_(offdiagonal),recycle_(recycle){
+        z_.resize(nsites_);
+        p_.resize(nsites_);
+        pending_.resize(nsites_);
+        cpmsample_.resize(nsites_);
+        if(offdiagonal_){
+            pairs_.assign(nsites_*(nsites_-1)/2,std::vector<int>(2));
+        }
+        if(recycle_){
+            czzstate_.resize(nsites_);
+            czzdelta_.resize(nsites_);
+            czzsweep_.resize(nsites_);
+            jpairs_.reserve(4);
+        }
+    }
+
+    void Run(int nsweeps,double thermfactor,int seed){
+        const int nflips=hamiltonian_.MinFlips();
+
+        sq_.assign(nsites_,StreamingBinning());
+        czz_.assign(nsites_,StreamingBinning());
+        cpm_.assign(nsites_,StreamingBinning());
+        sqrec_.assign(nsites_,StreamingBinning());
+        czzrec_.assign(nsites_,StreamingBinning());
+        haspending_=false;
+
+        std::cout<<"# Measuring the correlation functions"<<(offdiagonal_?" (with C+-)":"");
+        std::cout<<(recycle_?" (with waste recycling of Czz and S)":"")<<std::endl;
+
+        Sampler<Nqs,Hamiltonian> sampler(wf_,hamiltonian_,seed);
+        sampler.Equilibrate(nsweeps,thermfactor,nflips);
+
+        if(recycle_){
+            InitRecycling(sampler.State());
+        }
+        auto observer=[this](const std::vector<int> & state,const std::vector<int> & flips,double acceptance){
+            RecycleProposal(state,flips,acceptance);
+        };
+
+        for(int n=0;n<nsweeps;n++){
+            if(recycle_){
+                sampler.ObservedSweep(nflips,observer);
+                MeasureRecycled(sampler.State());
+            }
+            else{
+                sampler.Sweep(nflips);
+            }
+            MeasureDiagonal(sampler.State());
+            if(offdiagonal_){
+                MeasureOffDiagonal(sampler.State());
+            }
+        }
+        if(haspending_){
+            Transform(pending_,0);
+        }
+
+        Print();
+    }
+
+private:
+
+    static int LinearSize(int nsites,int dim){
+        const int l=(dim==1)?nsites:int(std::lround(std::sqrt(double(nsites))));
+        if((dim==1 && l!=nsites) || (dim==2 && l*l!=nsites)){
+            std::cerr<<"# Error : The number of spins does not correspond to a square lattice"<<std::endl;
+            std::abort();
+        }
+        return l;
+    }
+
+    void MeasureDiagonal(const std::vector<int> & state){
+        if(!haspending_){
+            for(int i=0;i<nsites_;i++){
+                pending_[i]=double(state[i]);
+            }
+            haspending_=true;
+            return;
+        }
+        Transform(pending_,&state);
+        haspending_=false;
+    }
+
+    //transforms the sample s1 (and s2, if given) and accumulates S(q) and Czz(r)
+    //with z = s1 + i s2, the transforms of the two real samples are (Z_q + Z*_-q)/2 and (Z_q - Z*_-q)/2i
+    void Transform(const std::vector<double> & s1,const std::vector<int> * s2){
+        for(int i=0;i<nsites_;i++){
+            z_[i]=std::complex<double>(s1[i],s2?double((*s2)[i]):0.);
+        }
+        fft_.Transform(z_);
+
+        for(int q=0;q<nsites_;q++){
+            const std::complex<double> zq=z_[q];
+            const std::complex<double> zmq=std::conj(z_[Opposite(q)]);
+            const double sq1=std::norm(0.5*(zq+zmq))/double(nsites_);
+            const double sq2=std::norm(0.5*(zq-zmq))/double(nsites_);
+            p_[q]=std::complex<double>(sq1,sq2);
+        }
+        for(int q=0;q<nsites_;q++){
+            sq_[q].Add(p_[q].real());
+            if(s2){
+                sq_[q].Add(p_[q].imag());
+            }
+        }
+
+        //Czz(r) = sum_q S(q) exp(i q.r)/N, real for each sample
+        fft_.Transform(p_,true);
+        for(int r=0;r<nsites_;r++){
+            czz_[r].Add(p_[r].real()/double(nsites_));
+            if(s2){
+                czz_[r].Add(p_[r].imag()/double(nsites_));
+            }
+        }
+    }
+
+    //sigma^+_i sigma^-_j + h.c. exchanges antiparallel spins, with local estimator Psi(s')/Psi(s)
+    void MeasureOffDiagonal(const std::vector<int> & state){
+        int npairs=0;
+        for(int i=0;i<nsites_;i++){
+            for(int j=i+1;j<nsites_;j++){
+                if(state[i]!=state[j]){
+                    pairs_[npairs][0]=i;
+                    pairs_[npairs][1]=j;
+                    npairs++;
+                }
+            }
+        }
+
+        static const std::vector<int> nobase;
+        wf_.LogPoPMulti(state,nobase,pairs_,logpops_,npairs);
+
+        std::fill(cpmsample_.begin(),cpmsample_.end(),0.);
+        for(int k=0;k<npairs;k++){
+            const int i=pairs_[k][0];
+            const int j=pairs_[k][1];
+            const std::complex<double> ratio=std::exp(logpops_[k]);
+            cpmsample_[Displacement(i,j)]+=ratio;
+            cpmsample_[Displacement(j,i)]+=ratio;
+        }
+        for(int r=0;r<nsites_;r++){
+            cpm_[r].Add(cpmsample_[r]/double(nsites_));
+        }
+    }
+
+    //sum_j s_j s_{j+r} of a state, for all the distances r
+    void InitRecycling(const std::vector<int> & state){
+        recstate_=state;
+        lastflips_.clear();
+        std::fill(czzstate_.begin(),czzstate_.end(),0.);
+        for(int j=0;j<nsites_;j++){
+            for(int r=0;r<nsites_;r++){
+                czzstate_[r]+=double(state[j]*state[Translate(j,r)]);
+            }
+        }
+        std::fill(czzsweep_.begin(),czzsweep_.end(),0.);
+        nproposals_=0;
+    }
+
+    //the last proposal was accepted if its sites changed in the current state
+    void UpdateRecycledState(const std::vector<int> & state){
+        if(lastflips_.size()>0 && state[lastflips_[0]]!=recstate_[lastflips_[0]]){
+            for(const auto & flip : lastflips_){
+                recstate_[flip]=-recstate_[flip];
+            }
+            for(int r=0;r<nsites_;r++){
+                czzstate_[r]+=czzdelta_[r];
+            }
+        }
+        lastflips_.clear();
+    }
+
+    //contribution (1-a) Czz(r;s) + a Czz(r;s') of a proposal, called by the sampler before the Metropolis test
+    void RecycleProposal(const std::vector<int> & state,const std::vector<int> & flips,double acceptance){
+        UpdateRecycledState(state);
+        nproposals_+=1;
+        if(flips.size()==0){
+            for(int r=0;r<nsites_;r++){
+                czzsweep_[r]+=czzstate_[r];
+            }
+            return;
+        }
+
+        //only the products s_j s_{j+r} with j or j+r flipped change
+        for(int r=0;r<nsites_;r++){
+            const int mr=Opposite(r);
+            jpairs_.clear();
+            for(const auto & flip : flips){
+                for(const int j : {flip,Translate(flip,mr)}){
+                    if(std::find(jpairs_.begin(),jpairs_.end(),j)==jpairs_.end()){
+                        jpairs_.push_back(j);
+                    }
+                }
+            }
+            double delta=0;
+            for(const auto & j : jpairs_){
+                const int k=Translate(j,r);
+                const int sj=IsFlipped(j,flips)?-state[j]:state[j];
+                const int sk=IsFlipped(k,flips)?-state[k]:state[k];
+                delta+=double(sj*sk-state[j]*state[k]);
+            }
+            czzdelta_[r]=delta;
+            czzsweep_[r]+=czzstate_[r]+acceptance*delta;
+        }
+        lastflips_=flips;
+    }
+
+    //recycled Czz(r) of the last sweep, and its transform S(q)
+    void MeasureRecycled(const std::vector<int> & state){
+        UpdateRecycledState(state);
+        for(int r=0;r<nsites_;r++){
+            z_[r]=czzsweep_[r]/(nproposals_*double(nsites_));
+            czzrec_[r].Add(z_[r].real());
+        }
+        fft_.Transform(z_);
+        for(int q=0;q<nsites_;q++){
+            sqrec_[q].Add(z_[q].real());
+        }
+        std::fill(czzsweep_.begin(),czzsweep_.end(),0.);
+        nproposals_=0;
+    }
+
+    static inline bool IsFlipped(int site,const std::vector<int> & flips){
+        for(const auto & flip : flips){
+            if(flip==site){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //index of -q
+    inline int Opposite(int q)const{
+        if(dim_==1){
+            return (l_-q)%l_;
+        }
+        return (l_-q%l_)%l_+l_*((l_-q/l_)%l_);
+    }
+
+    //index of the displacement from site i to site j
+    inline int Displacement(int i,int j)const{
+        if(dim_==1){
+            return (j-i+l_)%l_;
+        }
+        return (j%l_-i%l_+l_)%l_+l_*((j/l_-i/l_+l_)%l_);
+    }
+
+    //index of the site i+r
+    inline int Translate(int i,int r)const{
+        if(dim_==1){
+            return (i+r)%l_;
+        }
+        return (i%l_+r%l_)%l_+l_*((i/l_+r/l_)%l_);
+    }
+
+    void Print()const{
+        std::cout<<"# Structure factor, q=2 pi (kx,ky)/"<<l_<<std::endl;
+        std::cout<<"# kx"<<((dim_==2)?" ky":"")<<"  S(q)  error"<<(recycle_?"  S(q) recycled  error":"")<<std::endl;
+        for(int q=0;q<nsites_;q++){
+            std::cout<<q%l_;
+            if(dim_==2){
+                std::cout<<" "<<q/l_;
+            }
+            std::cout<<"  "<<std::scientific<<std::setprecision(6)<<sq_[q].Mean().real()<<"  "<<std::setprecision(1)<<sq_[q].Error();
+            if(recycle_){
+                std::cout<<"  "<<std::setprecision(6)<<sqrec_[q].Mean().real()<<"  "<<std::setprecision(1)<<sqrec_[q].Error();
+            }
+            std::cout<<std::endl;
+            std::cout<<std::defaultfloat;
+        }
+
+        std::cout<<"# Correlation functions"<<std::endl;
+        std::cout<<"# rx"<<((dim_==2)?" ry":"")<<"  Czz(r)  error"<<(offdiagonal_?"  C+-(r)  error":"");
+        std::cout<<(recycle_?"  Czz(r) recycled  error":"")<<std::endl;
+        for(int r=0;r<nsites_;r++){
+            std::cout<<r%l_;
+            if(dim_==2){
+                std::cout<<" "<<r/l_;
+            }
+            std::cout<<"  "<<std::scientific<<std::setprecision(6)<<czz_[r].Mean().real()<<"  "<<std::setprecision(1)<<czz_[r].Error();
+            if(offdiagonal_){
+                std::cout<<"  "<<std::setprecision(6)<<cpm_[r].Mean().real()<<"  "<<std::setprecision(1)<<cpm_[r].Error();
+            }
+            if(recycle_){
+                std::cout<<"  "<<std::setprecision(6)<<czzrec_[r].Mean().real()<<"  "<<std::setprecision(1)<<czzrec_[r].Error();
+            }
+            std::cout<<std::endl;
+            std::cout<<std::defaultfloat;
+        }
+
+        if(recycle_){
+            std::cout<<"# Variance reduction factor of waste recycling, averaged over the momenta : ";
+            std::cout<<std::fixed<<std::setprecision(2)<<VarianceReduction(sq_,sqrec_)<<std::endl;
+            std::cout<<"# Variance reduction factor of waste recycling, averaged over the distances r!=0 : ";
+            std::cout<<VarianceReduction(czz_,czzrec_)<<std::endl;
+            std::cout<<std::defaultfloat;
+        }
+    }
+
+    //mean ratio of the variances of the two estimators, over the entries with non-zero errors
+    static double VarianceReduction(const std::vector<StreamingBinning> & plain,const std::vector<StreamingBinning> & recycled){
+        double sum=0;
+        int n=0;
+        for(int i=0;i<int(plain.size());i++){
+            if(plain[i].Error()>0 && recycled[i].Error()>0){
+                sum+=std::pow(plain[i].Error()/recycled[i].Error(),2);
+                n++;
+            }
+        }
+        return (n>0)?sum/double(n):1.;
+    }
+
+};
@@ -0,0 +1,94 @@
+//
+//  exact.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include "nqs_paper.h"
+
+//Exact expectation values on small systems, by enumeration of all the spin configurations
+//used to validate the Monte Carlo estimates
+
+//largest number of spins for which the enumeration is attempted
+const int kMaxExactSpins=20;
+
+//spin configuration encoded in the bits of an integer (bit i set means spin up)
+inline void DecodeState(long code,std::vector<int> & state){
+    for(int i=0;i<int(state.size());i++){
+        state[i]=((code>>i)&1)?1:-1;
+    }
+}
+
+//Exact energy per spin of the given wave-function, <Psi|H|Psi>/<Psi|Psi>/N
+//if the hamiltonian conserves the magnetization (MinFlips()==2) only the zero-magnetization sector is enumerated,
+//as done in the Monte Carlo sampling
+template<class Wf,class Hamiltonian> double ExactEnergy(Wf & wf,Hamiltonian & hamiltonian){
+    const int nspins=wf.Nspins();
+
+    if(nspins>kMaxExactSpins){
+        std::cerr<<"# Error : Exact enumeration is possible only up to "<<kMaxExactSpins<<" spins"<<std::endl;
+        std::abort();
+    }
+
+    const bool mag0=(hamiltonian.MinFlips()==2);
+    const long nstates=1L<<nspins;
+
+    std::vector<int> state(nspins);
+
+    //logarithms of the amplitudes, configurations outside the sector are marked as excluded
+    std::vector<std::complex<double> > logpsi(nstates);
+    std::vector<char> insector(nstates,0);
+    double logmax=-1.0e300;
+
+    for(long code=0;code<nstates;code++){
+        DecodeState(code,state);
+
+        if(mag0){
+            int mag=0;
+            for(const auto & s : state){
+                mag+=s;
+            }
+            if(mag!=0){
+                continue;
+            }
+        }
+
+        insector[code]=1;
+        logpsi[code]=wf.LogVal(state);
+        logmax=std::max(logmax,logpsi[code].real());
+    }
+
+    std::vector<std::vector<int> > flipsh;
+    std::vector<std::complex<double> > mel;
+
+    double norm=0;
+    std::complex<double> energy=0.;
+
+    for(long code=0;code<nstates;code++){
+        if(!insector[code]){
+            continue;
+        }
+        DecodeState(code,state);
+
+        const std::complex<double> psi=std::exp(logpsi[code]-logmax);
+        norm+=std::norm(psi);
+
+        hamiltonian.FindConn(state,flipsh,mel);
+
+        for(int k=0;k<int(flipsh.size());k++){
+            long codep=code;
+            for(const auto & flip : flipsh[k]){
+                codep^=(1L<<flip);
+            }
+            if(!insector[codep]){
+                continue;
+            }
+            energy+=std::conj(psi)*mel[k]*std::exp(logpsi[codep]-logmax);
+        }
+    }
+
+    return energy.real()/norm/double(nspins);
+}
@@ -0,0 +1,171 @@
+//
+//  fastmath.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "nqs_paper.h"
+
+//Polynomial approximations of the elementary functions entering the acceptance ratios
+//The Metropolis test does not need full double precision, so these are used
+//in place of the library functions when a lower accuracy tier is selected
+//Measured quantities (local energies, derivatives) are always computed exactly
+
+//accuracy tiers, with the maximum absolute error of ReLncosh
+//(the largest errors occur close to the zeros of cosh, where the ratios are vanishingly small)
+//kAccuracyExact  : library functions
+//kAccuracyFast   : about 2e-8
+//kAccuracyCoarse : about 2e-4
+enum Accuracy{kAccuracyExact=0,kAccuracyFast=1,kAccuracyCoarse=2};
+
+inline Accuracy AccuracyFromString(std::string name){
+    if(name=="exact"){
+        return kAccuracyExact;
+    }
+    if(name=="fast"){
+        return kAccuracyFast;
+    }
+    if(name=="coarse"){
+        return kAccuracyCoarse;
+    }
+    std::cerr<<"# Error : Unknown accuracy tier "<<name<<" (allowed are exact, fast, coarse)"<<std::endl;
+    std::abort();
+}
+
+inline std::string AccuracyName(int accuracy){
+    const char * names[]={"exact","fast","coarse"};
+    return names[accuracy];
+}
+
+//exp(x), x=k*ln2+r with |r|<=ln2/2 and 2^k built from the exponent bits
+//relative error below 1e-8 (coarse: 6e-5) for |x|<700
+//k is rounded by adding 1.5*2^52, which leaves it in the low bits of the sum, so that there are no branches
+//or conversions between integers and doubles and loops over x can be vectorized
+template<bool coarse> inline double FastExp(double x){
+    x=std::max(-700.,std::min(700.,x));
+
+    const double shifter=6755399441055744.;
+    const double kshifted=x*M_LOG2E+shifter;
+    const double k=kshifted-shifter;
+    const double r=x-k*M_LN2;
+
+    double p;
+    if(coarse){
+        p=1.+r*(1.+r*(1./2.+r*(1./6.+r*(1./24.))));
+    }
+    else{
+        p=1.+r*(1.+r*(1./2.+r*(1./6.+r*(1./24.+r*(1./120.+r*(1./720.+r*(1./5040.)))))));
+    }
+
+    int64_t bits;
+    std::memcpy(&bits,&kshifted,sizeof(double));
+    bits=(bits+1023)<<52;
+    double scale;
+    std::memcpy(&scale,&bits,sizeof(double));
+    return p*scale;
+}
+
+//cos(y), reduced to [-pi/2,pi/2] and evaluated with an even polynomial
+//absolute error below 1e-8 (coarse: 3e-5)
+template<bool coarse> inline double FastCos(double y){
+    y-=2.*M_PI*std::floor(y*(0.5*M_1_PI)+0.5);
+
+    double sign=1.;
+    if(y>M_PI_2){
+        y-=M_PI;
+        sign=-1.;
+    }
+    else if(y<-M_PI_2){
+        y+=M_PI;
+        sign=-1.;
+    }
+
+    const double z=y*y;
+    double p;
+    if(coarse){
+        p=1.-z*(1./2.-z*(1./24.-z*(1./720.-z*(1./40320.))));
+    }
+    else{
+        p=1.-z*(1./2.-z*(1./24.-z*(1./720.-z*(1./40320.-z*(1./3628800.-z*(1./479001600.))))));
+    }
+    return sign*p;
+}
+
+//log(x) for x>0, x=m*2^e with m in [sqrt(1/2),sqrt(2)), and log(m)=2 atanh((m-1)/(m+1))
+//absolute error below 1e-9 (coarse: 2e-6)
+//the exponent is converted to a double through the bits of 2^52+e, without branches
+template<bool coarse> inline double FastLog(double x){
+    int64_t bits;
+    std::memcpy(&bits,&x,sizeof(double));
+
+    int64_t ebits=((bits>>52)&0x7ff)|0x4330000000000000LL;
+    double e;
+    std::memcpy(&e,&ebits,sizeof(double));
+    e-=4503599627370496.+1023.;
+
+    bits=(bits&0x000fffffffffffffLL)|0x3ff0000000000000LL;
+    double m;
+    std::memcpy(&m,&bits,sizeof(double));
+
+    const bool large=(m>M_SQRT2);
+    m=large?(0.5*m):m;
+    e=large?(e+1.):e;
+
+    const double t=(m-1.)/(m+1.);
+    const double t2=t*t;
+    double p;
+    if(coarse){
+        p=2.*t*(1.+t2*(1./3.+t2*(1./5.)));
+    }
+    else{
+        p=2.*t*(1.+t2*(1./3.+t2*(1./5.+t2*(1./7.+t2*(1./9.)))));
+    }
+    return p+e*M_LN2;
+}
+
+//real part of ln(cosh(x+iy)) = |x| - ln2 + ln(1 + q^2 + 2 q cos(2y))/2, with q=exp(-2|x|)
+template<bool coarse> inline double FastReLncosh(double x,double y){
+    const double ax=std::abs(x);
+    const double q=FastExp<coarse>(-2.*ax);
+    return ax-M_LN2+0.5*FastLog<coarse>(1.+q*q+2.*q*FastCos<coarse>(2.*y));
+}
+
+//ln(cosh(x)) for real x = |x| - ln2 + ln(1+q), without branches on x so that loops over it can be vectorized
+template<bool coarse> inline double FastLncosh(double x){
+    const double ax=std::abs(x);
+    return ax-M_LN2+FastLog<coarse>(1.+FastExp<coarse>(-2.*ax));
+}
+
+//same quantity computed with the library functions
+inline double ReLncosh(double x,double y){
+    const double ax=std::abs(x);
+    const double q=std::exp(-2.*ax);
+    return ax-M_LN2+0.5*std::log(1.+q*q+2.*q*std::cos(2.*y));
+}
+
+inline double ReLncosh(std::complex<double> theta,int accuracy){
+    switch(accuracy){
+        case kAccuracyFast:
+            return FastReLncosh<false>(theta.real(),theta.imag());
+        case kAccuracyCoarse:
+            return FastReLncosh<true>(theta.real(),theta.imag());
+        default:
+            return ReLncosh(theta.real(),theta.imag());
+    }
+}
+
+inline double AccuracyExp(double x,int accuracy){
+    switch(accuracy){
+        case kAccuracyFast:
+            return FastExp<false>(x);
+        case kAccuracyCoarse:
+            return FastExp<true>(x);
+        default:
+            return std::exp(x);
+    }
+}
@@ -0,0 +1,133 @@
+//
+//  fft.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include "nqs_paper.h"
+
+//Discrete Fourier transforms on periodic chains (dim=1) and square lattices (dim=2) of side l
+//A mixed-radix Cooley-Tukey algorithm is used, so that any l is allowed (e.g. l=40,80,10)
+//Transform computes sum_j x_j exp(-+ 2 pi i k.j/l) without normalization
+class Fft{
+
+    //linear size
+    const int l_;
+
+    //dimension of the lattice (1 or 2)
+    const int dim_;
+
+    //prime factors of l
+    std::vector<int> factors_;
+
+    //twiddle factors exp(-2 pi i k/l)
+    std::vector<std::complex<double> > twiddle_;
+
+    //scratch space, one buffer per recursion level
+    std::vector<std::vector<std::complex<double> > > scratch_;
+    std::vector<std::complex<double> > line_;
+    std::vector<std::complex<double> > linet_;
+
+public:
+
+    Fft(int l,int dim=1):l_(l),dim_(dim){
+        if(l_<1 || dim_<1 || dim_>2){
+            std::cerr<<"# Error : FFT is implemented only for 1d chains and 2d square lattices"<<std::endl;
+            std::abort();
+        }
+
+        int n=l_;
+        for(int p=2;p<=n;p++){
+            while(n%p==0){
+                factors_.push_back(p);
+                n/=p;
+            }
+        }
+
+        twiddle_.resize(l_);
+        for(int k=0;k<l_;k++){
+            const double phase=-2.*M_PI*double(k)/double(l_);
+            twiddle_[k]=std::complex<double>(std::cos(phase),std::sin(phase));
+        }
+
+        scratch_.resize(factors_.size()+1);
+        n=l_;
+        for(int f=0;f<int(factors_.size());f++){
+            scratch_[f].resize(n);
+            n/=factors_[f];
+        }
+
+        line_.resize(l_);
+        linet_.resize(l_);
+    }
+
+    //total number of sites
+    inline int Nsites()const{
+        return (dim_==1)?l_:(l_*l_);
+    }
+
+    //In-place transform of x, which contains Nsites() values
+    //site (ix,iy) has index ix+l*iy
+    //inverse=true uses the exp(+2 pi i k.j/l) kernel
+    void Transform(std::vector<std::complex<double> > & x,bool inverse=false){
+        if(dim_==1){
+            Transform1d(&x[0],1,inverse);
+        }
+        else{
+            for(int iy=0;iy<l_;iy++){
+                Transform1d(&x[iy*l_],1,inverse);
+            }
+            for(int ix=0;ix<l_;ix++){
+                Transform1d(&x[ix],l_,inverse);
+            }
+        }
+    }
+
+private:
+
+    //transform of l values separated by "stride"
+    void Transform1d(std::complex<double> * x,int stride,bool inverse){
+        for(int i=0;i<l_;i++){
+            line_[i]=x[i*stride];
+        }
+        Recursive(&line_[0],1,&linet_[0],l_,0,inverse);
+        for(int i=0;i<l_;i++){
+            x[i*stride]=linet_[i];
+        }
+    }
+
+    //out[k]=sum_j in[j*stride] exp(-+2 pi i j k/n), for a sub-problem of size n at recursion level "level"
+    void Recursive(const std::complex<double> * in,int stride,std::complex<double> * out,int n,int level,bool inverse){
+        if(n==1){
+            out[0]=in[0];
+            return;
+        }
+
+        const int p=factors_[level];
+        const int m=n/p;
+        const int tstep=l_/n;
+
+        std::complex<double> * sub=&scratch_[level][0];
+
+        //sub-transforms of the p decimated sequences
+        for(int r=0;r<p;r++){
+            Recursive(in+r*stride,stride*p,sub+r*m,m,level+1,inverse);
+        }
+
+        for(int k=0;k<n;k++){
+            std::complex<double> sum=sub[k%m];
+            for(int r=1;r<p;r++){
+                std::complex<double> tw=twiddle_[(r*k*tstep)%l_];
+                if(inverse){
+                    tw=std::conj(tw);
+                }
+                sum+=tw*sub[r*m+k%m];
+            }
+            out[k]=sum;
+        }
+    }
+
+};
@@ -0,0 +1,218 @@
+//
+//  fidelity.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <complex>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include "nqs_paper.h"
+
+//Fidelity |<Psi_0|Psi_k>|^2/(<Psi_0|Psi_0><Psi_k|Psi_k>) between a reference network Psi_0 and several targets Psi_k
+//estimated as F_k = <Psi_k/Psi_0>_0 <Psi_0/Psi_k>_k, where <.>_k is the average over samples of |Psi_k|^2
+//Chains sampling the reference evaluate the ratios of all the targets at once, and the chains sampling each target
+//evaluate the ratio of the reference; the networks that are not sampled follow the chain with their own look-up tables,
+//updated with the spins that changed between consecutive samples
+//The chains run on a pool of threads, and the averages are accumulated with a streaming binning analysis
+template<class Hamiltonian> class Fidelity{
+
+    //reference wave-function
+    Nqs & ref_;
+
+    Hamiltonian & hamiltonian_;
+
+    //targets, and their file names
+    std::vector<std::unique_ptr<Nqs> > targets_;
+    std::vector<std::string> names_;
+
+    //number of chains sampling each wave-function
+    const int nchains_;
+
+    //number of threads running the chains
+    const int nthreads_;
+
+    const int nflips_;
+
+    //the log-ratios of target k are shifted by shift_[k], to keep the ratios within the range of doubles
+    //(the shift cancels in the product of the two averages)
+    std::vector<double> shift_;
+
+    //averages of Psi_k/Psi_0 on the chains of the reference (ratios_[k][c])
+    //and of Psi_0/Psi_k on the chains of target k (invratios_[k][c])
+    std::vector<std::vector<StreamingBinning> > ratios_;
+    std::vector<std::vector<StreamingBinning> > invratios_;
+
+    //the look-up tables of the networks following a chain are computed again from scratch every kLtRefresh samples
+    static const int kLtRefresh=100;
+
+public:
+
+    Fidelity(Nqs & ref,Hamiltonian & hamiltonian,int nchains,int nthreads):
+    ref_(ref),hamiltonian_(hamiltonian),nchains_(nchains),nthreads_(std::max(nthreads,1)),nflips_(hamiltonian.MinFlips()){
+        if(nchains_<1){
+            std::cerr<<"# Error : The number of chains should be at least 1"<<std::endl;
+            std::abort();
+        }
+    }
+
+    void AddTarget(std::string filename){
+        targets_.push_back(std::unique_ptr<Nqs>(new Nqs(filename)));
+        names_.push_back(filename);
+
+        if(targets_.back()->Nspins()!=ref_.Nspins()){
+            std::cerr<<"# Error : The target wave-functions must have the same number of spins as the reference"<<std::endl;
+            std::abort();
+        }
+    }
+
+    //nsweeps samples of each wave-function, divided among the chains
+    void Run(int nsweeps,double thermfactor,int seed){
+        const int ntargets=targets_.size();
+        const int nperchain=nsweeps/nchains_;
+
+        std::cout<<"# Fidelity of "<<ntargets<<" networks with the reference, "<<nchains_<<" chains per network"<<std::endl;
+
+        ratios_.assign(ntargets,std::vector<StreamingBinning>(nchains_));
+        invratios_.assign(ntargets,std::vector<StreamingBinning>(nchains_));
+
+        ComputeShifts(seed);
+
+        //tasks 0..nchains-1 sample the reference, the following ones the targets
+        const int ntasks=nchains_*(1+ntargets);
+        std::atomic<int> next(0);
+
+        std::vector<std::thread> threads;
+        for(int t=0;t<std::min(nthreads_,ntasks);t++){
+            threads.push_back(std::thread([this,&next,ntasks,nperchain,thermfactor,seed](){
+                for(int task=next++;task<ntasks;task=next++){
+                    RunChain(task,nperchain,thermfactor,seed);
+                }
+            }));
+        }
+        for(auto & thread : threads){
+            thread.join();
+        }
+
+        std::cout<<"# file  fidelity  error  <Psi_k/Psi_0>_0  <Psi_0/Psi_k>_k"<<std::endl;
+        for(int k=0;k<ntargets;k++){
+            std::complex<double> mean,invmean;
+            double error,inverror;
+            CombineChains(ratios_[k],mean,error);
+            CombineChains(invratios_[k],invmean,inverror);
+
+            const double fidelity=(mean*invmean).real();
+            const double relerr=std::sqrt(std::pow(error/std::abs(mean),2)+std::pow(inverror/std::abs(invmean),2));
+
+            std::cout<<names_[k]<<"  "<<std::scientific<<std::setprecision(6)<<fidelity<<"  "<<std::setprecision(1)<<std::abs(fidelity)*relerr;
+            std::cout<<"  "<<std::setprecision(4)<<mean*std::exp(shift_[k])<<"  "<<invmean*std::exp(-shift_[k])<<std::endl;
+            std::cout<<std::defaultfloat;
+        }
+    }
+
+private:
+
+    //shift_[k] is the average of Re log(Psi_k/Psi_0) over a short chain of the reference
+    void ComputeShifts(int seed){
+        const int ntargets=targets_.size();
+        const int nshift=100;
+
+        shift_.assign(ntargets,0.);
+
+        Nqs ref(ref_);
+        Hamiltonian hamiltonian(hamiltonian_);
+        Sampler<Nqs,Hamiltonian> sampler(ref,hamiltonian,seed,nchains_*(1+ntargets));
+        sampler.Init(nflips_);
+        for(int n=0;n<nshift;n++){
+            sampler.Sweep(nflips_);
+        }
+        for(int n=0;n<nshift;n++){
+            sampler.Sweep(nflips_);
+            const std::complex<double> logref=ref.LogValLt(sampler.State());
+            for(int k=0;k<ntargets;k++){
+                shift_[k]+=(targets_[k]->LogVal(sampler.State())-logref).real()/double(nshift);
+            }
+        }
+    }
+
+    //samples the reference (task<nchains) or a target, evaluating the ratios with the networks following the chain
+    void RunChain(int task,int nsamples,double thermfactor,int seed){
+        const int c=task%nchains_;
+        const int k=task/nchains_-1;
+        const bool onref=(k<0);
+
+        Nqs sampled(onref?ref_:*targets_[k]);
+        Hamiltonian hamiltonian(hamiltonian_);
+
+        std::vector<std::unique_ptr<Nqs> > followers;
+        if(onref){
+            for(const auto & target : targets_){
+                followers.push_back(std::unique_ptr<Nqs>(new Nqs(*target)));
+            }
+        }
+        else{
+            followers.push_back(std::unique_ptr<Nqs>(new Nqs(ref_)));
+        }
+
+        Sampler<Nqs,Hamiltonian> sampler(sampled,hamiltonian,seed,task);
+        sampler.Equilibrate(nsamples,thermfactor,nflips_);
+
+        std::vector<int> previous(sampler.State());
+        std::vector<int> changed;
+        for(auto & follower : followers){
+            follower->InitLt(previous);
+        }
+
+        for(int n=0;n<nsamples;n++){
+            sampler.Sweep(nflips_);
+            const std::vector<int> & state=sampler.State();
+
+            changed.clear();
+            for(int i=0;i<int(state.size());i++){
+                if(state[i]!=previous[i]){
+                    changed.push_back(i);
+                }
+            }
+
+            const std::complex<double> logsampled=sampled.LogValLt(state);
+
+            for(int f=0;f<int(followers.size());f++){
+                Nqs & follower=*followers[f];
+                if(n%kLtRefresh==kLtRefresh-1){
+                    follower.InitLt(state);
+                }
+                else{
+                    follower.UpdateLt(previous,changed);
+                }
+
+                const std::complex<double> logfollower=follower.LogValLt(state);
+                if(onref){
+                    ratios_[f][c].Add(std::exp(logfollower-logsampled-shift_[f]));
+                }
+                else{
+                    invratios_[k][c].Add(std::exp(logfollower-logsampled+shift_[k]));
+                }
+            }
+
+            previous=state;
+        }
+    }
+
+    //average of the independent chains, with the error from the errors of each chain
+    static void CombineChains(const std::vector<StreamingBinning> & chains,std::complex<double> & mean,double & error){
+        mean=0.;
+        error=0;
+        for(const auto & chain : chains){
+            mean+=chain.Mean();
+            error+=std::pow(chain.Error(),2);
+        }
+        mean/=double(chains.size());
+        error=std::sqrt(error)/double(chains.size());
+    }
+
+};
@@ -0,0 +1,311 @@
+//
+//  graphhamiltonian.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <complex>
+#include <algorithm>
+#include <queue>
+#include "nqs_paper.h"
+
+//XXZ model with transverse field on an arbitrary graph
+//H = sum_<ij> [ Jz_ij sigma^z_i sigma^z_j + Jxy_ij (sigma^+_i sigma^-_j + h.c.) ] - h sum_i sigma^x_i
+//so that antiparallel spins on a bond are exchanged with matrix element 2*Jxy_ij
+//(Jxy=-1 reproduces the sign convention of Heisenberg1d and Heisenberg2d, Jz=-1 and Jxy=0 the Ising1d model)
+//
+//The graph is read from a text file containing
+//  nspins N        number of sites
+//  hfield h        (optional) transverse field, default 0
+//  i j Jz Jxy      one line per bond, sites are numbered from 0
+//lines starting with # are ignored
+class GraphHamiltonian{
+
+    //number of spins
+    int nspins_;
+
+    //value of the transverse field
+    double hfield_;
+
+    //reverse Cuthill-McKee order of the sites
+    std::vector<int> order_;
+
+    //bonds, stored as flat arrays following the reverse Cuthill-McKee order of the sites:
+    //the bonds of each site are contiguous and sorted by the rank of the neighbour, so that FindConn reads
+    //the spins of a narrow band of sites (these arrays are the only copy of the graph)
+    std::vector<int> bondi_;
+    std::vector<int> bondj_;
+    std::vector<double> jz_;
+
+    //bonds with non-zero exchange coupling, and the corresponding matrix elements 2*Jxy
+    std::vector<int> xbondi_;
+    std::vector<int> xbondj_;
+    std::vector<double> xmel_;
+
+    //pre-computed single spin flips for the transverse field
+    std::vector<std::vector<int> > fieldflips_;
+
+public:
+
+    GraphHamiltonian(std::string filename){
+        LoadGraph(filename);
+    }
+
+    //Finds the non-zero matrix elements of the hamiltonian
+    //on the given state
+    //i.e. all the state' such that <state'|H|state> = mel(state') \neq 0
+    //state' is encoded as the sequence of spin flips to be performed on state
+    void FindConn(const std::vector<int> & state,std::vector<std::vector<int> > & flipsh,std::vector<std::complex<double> > & mel){
+        const int nbonds=bondi_.size();
+        const int nxbonds=xbondi_.size();
+        const int nfield=fieldflips_.size();
+
+        //computing interaction part Sz*Sz
+        double diag=0;
+        for(int b=0;b<nbonds;b++){
+            diag+=jz_[b]*double(state[bondi_[b]]*state[bondj_[b]]);
+        }
+
+        //number of bonds with antiparallel spins
+        int nanti=0;
+        for(int b=0;b<nxbonds;b++){
+            nanti+=(1-state[xbondi_[b]]*state[xbondj_[b]])/2;
+        }
+
+        const int nconn=1+nfield+nanti;
+
+        //one extra element is used as a sink for the bonds that are not flippable
+        mel.resize(nconn+1);
+        flipsh.resize(nconn+1);
+
+        mel[0]=diag;
+        flipsh[0].clear();
+
+        for(int i=0;i<nfield;i++){
+            mel[i+1]=-hfield_;
+            flipsh[i+1]=fieldflips_[i];
+        }
+
+        int n=1+nfield;
+        for(int b=0;b<nxbonds;b++){
+            const int si=xbondi_[b];
+            const int sj=xbondj_[b];
+
+            flipsh[n].resize(2);
+            flipsh[n][0]=si;
+            flipsh[n][1]=sj;
+            mel[n]=xmel_[b];
+
+            n+=(1-state[si]*state[sj])/2;
+        }
+
+        mel.resize(nconn);
+        flipsh.resize(nconn);
+    }
+
+    //the magnetization is conserved when there is no transverse field
+    int MinFlips()const{
+        return (hfield_==0. && xbondi_.size()>0)?2:1;
+    }
+
+    inline int Nspins()const{
+        return nspins_;
+    }
+
+    //list of bonds, as pairs of sites
+    std::vector<std::vector<int> > Bonds()const{
+        std::vector<std::vector<int> > bonds;
+        for(int b=0;b<int(bondi_.size());b++){
+            bonds.push_back(std::vector<int>{bondi_[b],bondj_[b]});
+        }
+        return bonds;
+    }
+
+    void LoadGraph(std::string filename){
+        std::ifstream fin(filename.c_str());
+
+        if(!fin.good()){
+            std::cerr<<"# Error : Cannot load the graph from file "<<filename<<" : file not found."<<std::endl;
+            std::abort();
+        }
+
+        nspins_=-1;
+        hfield_=0;
+
+        std::vector<int> bi,bj;
+        std::vector<double> jz,jxy;
+
+        std::string line;
+        while(std::getline(fin,line)){
+            std::istringstream sline(line);
+            std::string first;
+            if(!(sline>>first) || first[0]=='#'){
+                continue;
+            }
+
+            if(first=="nspins"){
+                sline>>nspins_;
+            }
+            else if(first=="hfield"){
+                sline>>hfield_;
+            }
+            else{
+                int i=std::stoi(first);
+                int j;
+                double z,xy;
+                sline>>j>>z>>xy;
+                bi.push_back(i);
+                bj.push_back(j);
+                jz.push_back(z);
+                jxy.push_back(xy);
+            }
+
+            if(sline.fail()){
+                std::cerr<<"# Error : invalid line in graph file "<<filename<<" : "<<line<<std::endl;
+                std::abort();
+            }
+        }
+
+        if(nspins_<=0){
+            std::cerr<<"# Error : the graph file must specify a positive number of spins"<<std::endl;
+            std::abort();
+        }
+        for(int b=0;b<int(bi.size());b++){
+            if(bi[b]<0 || bi[b]>=nspins_ || bj[b]<0 || bj[b]>=nspins_ || bi[b]==bj[b]){
+                std::cerr<<"# Error : invalid bond "<<bi[b]<<" "<<bj[b]<<" in graph file "<<filename<<std::endl;
+                std::abort();
+            }
+        }
+
+        InitTables(bi,bj,jz,jxy);
+
+        std::cout<<"# Using the XXZ model on the graph "<<filename<<" with "<<nspins_<<" sites, ";
+        std::cout<<bondi_.size()<<" bonds and h = "<<hfield_<<std::endl;
+        std::cout<<"# Adjacency bandwidth after reverse Cuthill-McKee ordering is "<<Bandwidth()<<std::endl;
+    }
+
+private:
+
+    //builds the flat bond tables, in the reverse Cuthill-McKee order of the sites
+    void InitTables(const std::vector<int> & bi,const std::vector<int> & bj,const std::vector<double> & jz,const std::vector<double> & jxy){
+        const int nbonds=bi.size();
+
+        //adjacency lists, each entry is (neighbour, bond index)
+        std::vector<std::vector<std::pair<int,int> > > neigh(nspins_);
+        for(int b=0;b<nbonds;b++){
+            neigh[bi[b]].push_back(std::make_pair(bj[b],b));
+            neigh[bj[b]].push_back(std::make_pair(bi[b],b));
+        }
+
+        ReverseCuthillMcKee(neigh);
+
+        std::vector<int> rank(nspins_);
+        for(int r=0;r<nspins_;r++){
+            rank[order_[r]]=r;
+        }
+
+        bondi_.clear();
+        bondj_.clear();
+        jz_.clear();
+        xbondi_.clear();
+        xbondj_.clear();
+        xmel_.clear();
+
+        for(int r=0;r<nspins_;r++){
+            const int i=order_[r];
+
+            std::vector<std::pair<int,int> > row=neigh[i];
+            std::sort(row.begin(),row.end(),[&rank](const std::pair<int,int> & x,const std::pair<int,int> & y){
+                return rank[x.first]<rank[y.first];
+            });
+
+            for(const auto & nb : row){
+                const int j=nb.first;
+                const int b=nb.second;
+
+                //each bond is stored once, in the row of its first site in the ordering
+                if(rank[i]<rank[j]){
+                    bondi_.push_back(i);
+                    bondj_.push_back(j);
+                    jz_.push_back(jz[b]);
+                    if(jxy[b]!=0.){
+                        xbondi_.push_back(i);
+                        xbondj_.push_back(j);
+                        xmel_.push_back(2.*jxy[b]);
+                    }
+                }
+            }
+        }
+
+        fieldflips_.clear();
+        if(hfield_!=0.){
+            for(int i=0;i<nspins_;i++){
+                fieldflips_.push_back(std::vector<int>(1,i));
+            }
+        }
+    }
+
+    //reverse Cuthill-McKee ordering of the sites, stored in order_
+    //each connected component is started from a vertex of minimal degree
+    void ReverseCuthillMcKee(const std::vector<std::vector<std::pair<int,int> > > & neigh){
+        std::vector<int> bydegree(nspins_);
+        for(int i=0;i<nspins_;i++){
+            bydegree[i]=i;
+        }
+        std::stable_sort(bydegree.begin(),bydegree.end(),[&neigh](int x,int y){
+            return neigh[x].size()<neigh[y].size();
+        });
+
+        std::vector<bool> visited(nspins_,false);
+        order_.clear();
+
+        for(int start : bydegree){
+            if(visited[start]){
+                continue;
+            }
+
+            std::queue<int> q;
+            q.push(start);
+            visited[start]=true;
+
+            while(!q.empty()){
+                const int i=q.front();
+                q.pop();
+                order_.push_back(i);
+
+                std::vector<int> next;
+                for(const auto & nb : neigh[i]){
+                    if(!visited[nb.first]){
+                        visited[nb.first]=true;
+                        next.push_back(nb.first);
+                    }
+                }
+                std::stable_sort(next.begin(),next.end(),[&neigh](int x,int y){
+                    return neigh[x].size()<neigh[y].size();
+                });
+                for(int j : next){
+                    q.push(j);
+                }
+            }
+        }
+
+        std::reverse(order_.begin(),order_.end());
+    }
+
+    //maximum distance in the ordering between the two sites of a bond
+    int Bandwidth()const{
+        std::vector<int> rank(nspins_);
+        for(int r=0;r<nspins_;r++){
+            rank[order_[r]]=r;
+        }
+        int bw=0;
+        for(int b=0;b<int(bondi_.size());b++){
+            bw=std::max(bw,std::abs(rank[bondi_[b]]-rank[bondj_[b]]));
+        }
+        return bw;
+    }
+
+};
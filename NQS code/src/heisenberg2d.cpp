@@ -99,6 +99,11 @@ public:
         return 2;
     }
     
+    //list of nearest-neighbour bonds
+    const std::vector<std::vector<int> > & Bonds()const{
+        return bonds_;
+    }
+    
     
     //Small functions to set up the lattice
     //Horizontal Pbc
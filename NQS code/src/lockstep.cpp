@@ -0,0 +1,550 @@
+//
+//  lockstep.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <complex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include "nqs_paper.h"
+
+//Sampling of blocks of K Markov chains (lanes) advanced in lockstep
+//all the lanes of a block propose the flip of the same site at each move, so the row W_[flip] is loaded
+//once per hidden unit and updates the K thetas of the lanes, which are stored in a nh x K block (lane index innermost)
+//with two flips each lane exchanges the common site with a partner drawn among its spins antiparallel to it
+//(as the exchanges of Sampler, every proposal is valid), whose weights are gathered from the transposed weights
+//each lane accepts or rejects with its own random stream, and the tables of the rejected lanes are left unchanged
+//by a masked copy
+//with the fast and coarse accuracy tiers the lncosh of the lanes are evaluated with branch-free polynomials,
+//so that the loops over the lanes can be vectorized (real networks only)
+//the local energies are computed exactly, lane by lane, and the blocks run on a pool of threads
+//with automatic thermalization the local energy of each lane is recorded after each sweep, and a block is
+//thermalized when the traces of all its lanes have passed the test used by Sampler::Thermalize
+template<class Hamiltonian> class LockstepChains{
+
+    Hamiltonian & hamiltonian_;
+
+    //weights W_[i*nh_+h], visible and hidden biases, and real parts of the weights for real networks
+    //Wt_ and Wtre_ are the transposed weights Wt_[h*nv_+i], read by the partners of the exchanges
+    std::vector<std::complex<double> > W_;
+    std::vector<double> Wre_;
+    std::vector<std::complex<double> > Wt_;
+    std::vector<double> Wtre_;
+    std::vector<std::complex<double> > a_;
+    std::vector<std::complex<double> > b_;
+    bool real_;
+
+    const int nv_;
+    const int nh_;
+
+    //number of lanes per block, and of blocks
+    const int nlanes_;
+    const int nblocks_;
+
+    const int nflips_;
+
+    //accuracy tier of the acceptance ratios (the local energies are always computed exactly)
+    int accuracy_;
+
+    //local energy of each lane, energy_[block][lane]
+    std::vector<std::vector<StreamingBinning> > energy_;
+
+    //whether the automatic thermalization of each block detected the equilibrium
+    std::vector<char> thermalized_;
+
+    //sweeps done and accepted moves of each block, and time (in seconds) spent in the moves and in the measurements
+    std::vector<double> sweeps_;
+    std::vector<double> accepted_;
+    std::vector<double> sweeptime_;
+    std::vector<double> meastime_;
+
+    //state of the lanes of a block, with thetas, lncosh(theta) and their values after the proposed move
+    template<class T> struct Lanes{
+        std::vector<std::vector<int> > state;
+        std::vector<T> lt;
+        std::vector<T> lnc;
+        std::vector<T> ltp;
+        std::vector<T> lncp;
+        std::vector<T> logr;
+        std::vector<double> coeff;
+        std::vector<char> accept;
+        std::vector<nqs::Philox> gen;
+        std::vector<std::vector<int> > flipsh;
+        std::vector<std::complex<double> > mel;
+
+        //with two flips: partner of the common site in each lane, sites of the up and down spins of each lane
+        //(spinsites[2*c] and spinsites[2*c+1]) and position of each site in its set
+        std::vector<int> partner;
+        std::vector<std::vector<int> > spinsites;
+        std::vector<std::vector<int> > position;
+    };
+
+public:
+
+    LockstepChains(Nqs & wf,Hamiltonian & hamiltonian,int nlanes,int nblocks):
+    hamiltonian_(hamiltonian),nv_(wf.Nspins()),nh_(wf.Nhidden()),nlanes_(nlanes),nblocks_(std::max(nblocks,1)),
+    nflips_(hamiltonian.MinFlips()),accuracy_(kAccuracyExact){
+        if(nlanes_<1){
+            std::cerr<<"# Error : The number of lockstep chains should be at least 1"<<std::endl;
+            std::abort();
+        }
+
+        const auto & W=wf.Weights();
+        a_=wf.VisibleBias();
+        b_=wf.HiddenBias();
+
+        W_.resize(nv_*nh_);
+        Wre_.resize(nv_*nh_);
+        Wt_.resize(nv_*nh_);
+        Wtre_.resize(nv_*nh_);
+        real_=true;
+        for(int i=0;i<nv_;i++){
+            for(int h=0;h<nh_;h++){
+                W_[i*nh_+h]=W[i][h];
+                Wre_[i*nh_+h]=W[i][h].real();
+                Wt_[h*nv_+i]=W[i][h];
+                Wtre_[h*nv_+i]=W[i][h].real();
+                real_=real_ && (W[i][h].imag()==0);
+            }
+            real_=real_ && (a_[i].imag()==0);
+        }
+        for(int h=0;h<nh_;h++){
+            real_=real_ && (b_[h].imag()==0);
+        }
+    }
+
+    //accuracy tier of the acceptance ratios, used only for real networks
+    void SetAccuracy(int accuracy){
+        accuracy_=accuracy;
+    }
+
+    //nsweeps samples of each lane, after nsweeps*thermfactor thermalization sweeps
+    //or automatic thermalization (thermfactor=-1) with at most nsweeps sweeps
+    void Run(int nsweeps,double thermfactor,int seed){
+        //all the blocks use streams of the same seed
+        seed=ResolveSeed(seed);
+
+        std::cout<<"# Lockstep sampling of "<<nblocks_<<" blocks of "<<nlanes_<<" chains"<<std::endl;
+
+        energy_.assign(nblocks_,std::vector<StreamingBinning>(nlanes_));
+        sweeps_.assign(nblocks_,0.);
+        thermalized_.assign(nblocks_,1);
+        accepted_.assign(nblocks_,0.);
+        sweeptime_.assign(nblocks_,0.);
+        meastime_.assign(nblocks_,0.);
+
+        std::atomic<int> next(0);
+        std::vector<std::thread> threads;
+        for(int t=0;t<nblocks_;t++){
+            threads.push_back(std::thread([this,&next,nsweeps,thermfactor,seed](){
+                for(int block=next++;block<nblocks_;block=next++){
+                    if(!real_){
+                        RunBlock<std::complex<double>,kAccuracyExact>(block,nsweeps,thermfactor,seed);
+                    }
+                    else if(accuracy_==kAccuracyFast){
+                        RunBlock<double,kAccuracyFast>(block,nsweeps,thermfactor,seed);
+                    }
+                    else if(accuracy_==kAccuracyCoarse){
+                        RunBlock<double,kAccuracyCoarse>(block,nsweeps,thermfactor,seed);
+                    }
+                    else{
+                        RunBlock<double,kAccuracyExact>(block,nsweeps,thermfactor,seed);
+                    }
+                }
+            }));
+        }
+        for(auto & thread : threads){
+            thread.join();
+        }
+
+        //average of the independent lanes, with the error from the errors of each lane
+        double energy=0;
+        double error=0;
+        double sweeps=0;
+        double accepted=0;
+        double sweeptime=0;
+        double meastime=0;
+        int nunthermalized=0;
+        for(int block=0;block<nblocks_;block++){
+            for(const auto & lane : energy_[block]){
+                energy+=lane.Mean().real();
+                error+=std::pow(lane.Error(),2);
+            }
+            sweeps+=sweeps_[block];
+            nunthermalized+=!thermalized_[block];
+            accepted+=accepted_[block];
+            sweeptime+=sweeptime_[block];
+            meastime+=meastime_[block];
+        }
+        //the times are summed over the blocks, each block running on a single thread
+        const double nchains=double(nblocks_)*double(nlanes_);
+        const double nmoves=sweeps*double(nlanes_)*double(nv_);
+        energy/=nchains*double(nv_);
+        error=std::sqrt(error)/(nchains*double(nv_));
+
+        if(nunthermalized>0){
+            std::cerr<<"# Warning : equilibrium was not detected within "<<nsweeps<<" thermalization sweeps in "<<nunthermalized<<" blocks"<<std::endl;
+        }
+        std::cout<<"# Acceptance : "<<std::fixed<<std::setprecision(3)<<accepted/nmoves<<std::endl;
+        std::cout<<"# Moves per second per thread : "<<std::scientific<<std::setprecision(3)<<nmoves/sweeptime<<std::endl;
+        std::cout<<"# Measurements per second per thread : "<<nchains*double(nsweeps)/meastime<<std::endl;
+        std::cout<<"# Estimated average energy per spin : "<<std::endl;
+        std::cout<<"# "<<std::setprecision(5)<<energy<<" +/-  "<<std::setprecision(0)<<error<<std::endl;
+        std::cout<<std::defaultfloat;
+    }
+
+private:
+
+    template<class T,int accuracy> void RunBlock(int block,int nsweeps,double thermfactor,int seed){
+        Hamiltonian hamiltonian(hamiltonian_);
+
+        Lanes<T> lanes;
+        lanes.state.resize(nlanes_);
+        lanes.gen.resize(nlanes_);
+        lanes.lt.resize(nh_*nlanes_);
+        lanes.lnc.resize(nh_*nlanes_);
+        lanes.ltp.resize(nh_*nlanes_);
+        lanes.lncp.resize(nh_*nlanes_);
+        lanes.logr.resize(nlanes_);
+        lanes.coeff.resize(2*nlanes_);
+        lanes.accept.resize(nlanes_);
+        lanes.partner.resize(nlanes_);
+
+        //the lanes use the streams of chains block*K..block*K+K-1, the proposals a stream following all of them
+        for(int c=0;c<nlanes_;c++){
+            lanes.gen[c].Seed(seed,block*nlanes_+c,nqs::Philox::kSampler);
+            InitRandomState(lanes.state[c],lanes.gen[c]);
+        }
+        nqs::Philox proposals;
+        proposals.Seed(seed,nblocks_*nlanes_+block,nqs::Philox::kSampler);
+
+        InitLt(lanes);
+        if(nflips_==2){
+            InitSpinSites(lanes);
+        }
+
+        //common flipped site of the lanes (the partners of the exchanges are in lanes.partner)
+        std::vector<int> flips(1);
+        std::vector<std::complex<double> > energies(nlanes_);
+
+        if(thermfactor<0){
+            thermalized_[block]=Thermalize<T,accuracy>(lanes,hamiltonian,proposals,flips,energies,block,nsweeps);
+        }
+        else{
+            for(int n=0;n<nsweeps*thermfactor;n++){
+                Sweep<T,accuracy>(lanes,proposals,flips,block);
+            }
+        }
+
+        for(int n=0;n<nsweeps;n++){
+            Sweep<T,accuracy>(lanes,proposals,flips,block);
+
+            const auto t0=std::chrono::steady_clock::now();
+            LocalEnergies(lanes,hamiltonian,energies);
+            for(int c=0;c<nlanes_;c++){
+                energy_[block][c].Add(energies[c]);
+            }
+            meastime_[block]+=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        }
+    }
+
+    //nv moves of all the lanes of a block
+    template<class T,int accuracy> void Sweep(Lanes<T> & lanes,nqs::Philox & proposals,std::vector<int> & flips,int block){
+        const auto t0=std::chrono::steady_clock::now();
+        for(int m=0;m<nv_;m++){
+            flips[0]=proposals.Index(nv_);
+            if(nflips_==2){
+                DrawPartners(lanes,flips[0]);
+            }
+            accepted_[block]+=Move<T,accuracy>(lanes,flips);
+        }
+        sweeptime_[block]+=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        sweeps_[block]+=1;
+    }
+
+    //automatic thermalization of a block, with at most maxsweeps sweeps
+    //every kCheckSweeps sweeps the local energy traces of the lanes are tested with Equilibrated,
+    //a lane that passed the test is not tested again
+    //returns false if the equilibrium is not detected in all the lanes
+    template<class T,int accuracy> bool Thermalize(Lanes<T> & lanes,Hamiltonian & hamiltonian,nqs::Philox & proposals,
+                                                   std::vector<int> & flips,std::vector<std::complex<double> > & energies,
+                                                   int block,int maxsweeps){
+        const int kCheckSweeps=20;
+
+        std::vector<std::vector<double> > traces(nlanes_);
+        std::vector<char> equilibrated(nlanes_,0);
+        int nequilibrated=0;
+        for(int n=1;n<=maxsweeps;n++){
+            Sweep<T,accuracy>(lanes,proposals,flips,block);
+
+            LocalEnergies(lanes,hamiltonian,energies);
+            for(int c=0;c<nlanes_;c++){
+                traces[c].push_back(energies[c].real());
+            }
+
+            if(n>=2*kCheckSweeps && n%kCheckSweeps==0){
+                for(int c=0;c<nlanes_;c++){
+                    if(!equilibrated[c] && Equilibrated(traces[c])){
+                        equilibrated[c]=1;
+                        nequilibrated++;
+                    }
+                }
+                if(nequilibrated==nlanes_){
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    //random state of a lane, with zero magnetization when the hamiltonian conserves it
+    void InitRandomState(std::vector<int> & state,nqs::Philox & gen)const{
+        state.resize(nv_);
+        for(int i=0;i<nv_;i++){
+            state[i]=(gen.Uniform()<0.5)?(-1):(1);
+        }
+
+        if(nflips_==2){
+            if(nv_%2){
+                std::cerr<<"# Error : Cannot initializate a random state with zero magnetization for odd number of spins"<<std::endl;
+                std::abort();
+            }
+            int mag=0;
+            for(int i=0;i<nv_;i++){
+                mag+=state[i];
+            }
+            while(mag!=0){
+                const int i=gen.Index(nv_);
+                if(state[i]*mag>0){
+                    state[i]=-state[i];
+                    mag+=2*state[i];
+                }
+            }
+        }
+    }
+
+    //sets of the up and down spins of each lane
+    template<class T> void InitSpinSites(Lanes<T> & lanes)const{
+        lanes.spinsites.assign(2*nlanes_,std::vector<int>());
+        lanes.position.assign(nlanes_,std::vector<int>(nv_));
+        for(int c=0;c<nlanes_;c++){
+            for(int i=0;i<nv_;i++){
+                std::vector<int> & sites=lanes.spinsites[2*c+((lanes.state[c][i]>0)?0:1)];
+                lanes.position[c][i]=sites.size();
+                sites.push_back(i);
+            }
+        }
+    }
+
+    //partner of the common site in each lane, uniformly among the spins antiparallel to it
+    //at zero magnetization each exchange is proposed with probability 4/nv^2 in both directions
+    template<class T> void DrawPartners(Lanes<T> & lanes,int site)const{
+        for(int c=0;c<nlanes_;c++){
+            const std::vector<int> & sites=lanes.spinsites[2*c+((lanes.state[c][site]>0)?1:0)];
+            lanes.partner[c]=sites[lanes.gen[c].Index(sites.size())];
+        }
+    }
+
+    //the exchanged sites swap their positions in the sets of the lane
+    template<class T> void ExchangeSpinSites(Lanes<T> & lanes,int c,int i,int j)const{
+        std::vector<int> & position=lanes.position[c];
+        const int si=(lanes.state[c][i]>0)?0:1;
+        lanes.spinsites[2*c+si][position[i]]=j;
+        lanes.spinsites[2*c+1-si][position[j]]=i;
+        std::swap(position[i],position[j]);
+    }
+
+    inline const double * WeightRows(double)const{
+        return &Wre_[0];
+    }
+    inline const std::complex<double> * WeightRows(std::complex<double>)const{
+        return &W_[0];
+    }
+    inline const double * WeightColumns(double)const{
+        return &Wtre_[0];
+    }
+    inline const std::complex<double> * WeightColumns(std::complex<double>)const{
+        return &Wt_[0];
+    }
+    static inline double Value(std::complex<double> x,double){
+        return x.real();
+    }
+    static inline std::complex<double> Value(std::complex<double> x,std::complex<double>){
+        return x;
+    }
+
+    //thetas and lncosh of all the lanes
+    template<class T> void InitLt(Lanes<T> & lanes)const{
+        const T * w=WeightRows(T());
+        const int K=nlanes_;
+
+        for(int h=0;h<nh_;h++){
+            for(int c=0;c<K;c++){
+                lanes.lt[h*K+c]=Value(b_[h],T());
+            }
+        }
+        for(int c=0;c<K;c++){
+            for(int i=0;i<nv_;i++){
+                const double si=double(lanes.state[c][i]);
+                for(int h=0;h<nh_;h++){
+                    lanes.lt[h*K+c]+=w[i*nh_+h]*si;
+                }
+            }
+        }
+        for(int h=0;h<nh_*K;h++){
+            lanes.lnc[h]=Nqs::lncosh(lanes.lt[h]);
+        }
+    }
+
+    //lncosh of the thetas of the proposed moves, with the accuracy tier of the acceptance ratios
+    //(only real networks use the approximate tiers)
+    template<int accuracy> static inline double LaneLncosh(double x){
+        return (accuracy==kAccuracyFast)?FastLncosh<false>(x):((accuracy==kAccuracyCoarse)?FastLncosh<true>(x):Nqs::lncosh(x));
+    }
+    template<int accuracy> static inline std::complex<double> LaneLncosh(std::complex<double> x){
+        return Nqs::lncosh(x);
+    }
+
+    //coefficients -2*state(flip) of the common flip and of the partners, and visible bias part of the log-ratios,
+    //for all the lanes
+    template<class T> void FlipCoefficients(Lanes<T> & lanes,const std::vector<int> & flips)const{
+        const int K=nlanes_;
+        for(int c=0;c<K;c++){
+            const double coeff=-2.*double(lanes.state[c][flips[0]]);
+            lanes.coeff[c]=coeff;
+            lanes.logr[c]=coeff*Value(a_[flips[0]],T());
+            if(nflips_==2){
+                //the partner is antiparallel to the common site
+                const int partner=lanes.partner[c];
+                lanes.coeff[K+c]=-coeff;
+                lanes.logr[c]-=coeff*Value(a_[partner],T());
+            }
+        }
+    }
+
+    //log(Psi(state')/Psi(state)) of all the lanes for the common flip (and the partners), in lanes.logr
+    //the thetas after the move and their lncosh are stored in lanes.ltp and lanes.lncp
+    template<class T,int accuracy> void ProposalRatios(Lanes<T> & lanes,const std::vector<int> & flips)const{
+        const T * w=WeightRows(T());
+        const T * wt=WeightColumns(T());
+        const int K=nlanes_;
+
+        FlipCoefficients(lanes,flips);
+
+        const double * coeff0=&lanes.coeff[0];
+        const double * coeff1=&lanes.coeff[K];
+        const int * partner=&lanes.partner[0];
+        const int row0=flips[0]*nh_;
+        T * logr=&lanes.logr[0];
+
+        for(int h=0;h<nh_;h++){
+            const T * lth=&lanes.lt[h*K];
+            const T * lnch=&lanes.lnc[h*K];
+            T * ltph=&lanes.ltp[h*K];
+            T * lncph=&lanes.lncp[h*K];
+
+            //the weight of the common site is loaded once for all the lanes
+            const T w0=w[row0+h];
+            if(nflips_==2){
+                const T * wth=&wt[h*nv_];
+                for(int c=0;c<K;c++){
+                    ltph[c]=lth[c]+coeff0[c]*w0+coeff1[c]*wth[partner[c]];
+                }
+            }
+            else{
+                for(int c=0;c<K;c++){
+                    ltph[c]=lth[c]+coeff0[c]*w0;
+                }
+            }
+            for(int c=0;c<K;c++){
+                lncph[c]=LaneLncosh<accuracy>(ltph[c]);
+                logr[c]+=lncph[c]-lnch[c];
+            }
+        }
+    }
+
+    //exact log(Psi(state')/Psi(state)) of lane c, lnbase is the exact sum of lncosh of its thetas
+    template<class T> T ExactRatio(const Lanes<T> & lanes,int c,const std::vector<int> & flips,T lnbase)const{
+        const T * w=WeightRows(T());
+        const int K=nlanes_;
+
+        T logr=-lnbase;
+        for(const auto & flip : flips){
+            logr-=2.*double(lanes.state[c][flip])*Value(a_[flip],T());
+        }
+        for(int h=0;h<nh_;h++){
+            T thetahp=lanes.lt[h*K+c];
+            for(const auto & flip : flips){
+                thetahp-=2.*double(lanes.state[c][flip])*w[flip*nh_+h];
+            }
+            logr+=Nqs::lncosh(thetahp);
+        }
+        return logr;
+    }
+
+    //one move of all the lanes, returns the number of accepted lanes
+    template<class T,int accuracy> int Move(Lanes<T> & lanes,const std::vector<int> & flips){
+        const int K=nlanes_;
+
+        ProposalRatios<T,accuracy>(lanes,flips);
+
+        int naccepted=0;
+        for(int c=0;c<K;c++){
+            const double u=lanes.gen[c].Uniform();
+            lanes.accept[c]=(u<std::norm(std::exp(std::complex<double>(lanes.logr[c]))));
+            naccepted+=lanes.accept[c];
+        }
+        if(naccepted==0){
+            return 0;
+        }
+
+        //masked update of the tables
+        const char * accept=&lanes.accept[0];
+        for(int h=0;h<nh_*K;h+=K){
+            T * lth=&lanes.lt[h];
+            T * lnch=&lanes.lnc[h];
+            const T * ltph=&lanes.ltp[h];
+            const T * lncph=&lanes.lncp[h];
+            for(int c=0;c<K;c++){
+                lth[c]=accept[c]?ltph[c]:lth[c];
+                lnch[c]=accept[c]?lncph[c]:lnch[c];
+            }
+        }
+        for(int c=0;c<K;c++){
+            if(accept[c]){
+                if(nflips_==2){
+                    ExchangeSpinSites(lanes,c,flips[0],lanes.partner[c]);
+                    lanes.state[c][lanes.partner[c]]*=-1;
+                }
+                lanes.state[c][flips[0]]*=-1;
+            }
+        }
+        return naccepted;
+    }
+
+    //local energies of all the lanes, with the exact ratios evaluated on the tables of each lane
+    template<class T> void LocalEnergies(Lanes<T> & lanes,Hamiltonian & hamiltonian,std::vector<std::complex<double> > & energies){
+        const int K=nlanes_;
+
+        for(int c=0;c<K;c++){
+            T lnbase=0.;
+            for(int h=0;h<nh_;h++){
+                lnbase+=Nqs::lncosh(lanes.lt[h*K+c]);
+            }
+
+            hamiltonian.FindConn(lanes.state[c],lanes.flipsh,lanes.mel);
+
+            energies[c]=0.;
+            for(int i=0;i<int(lanes.flipsh.size());i++){
+                energies[c]+=lanes.mel[i]*std::exp(std::complex<double>(ExactRatio(lanes,c,lanes.flipsh[i],lnbase)));
+            }
+        }
+    }
+
+};
@@ -8,59 +8,593 @@
 
 #include "nqs_paper.h"
 
-int main(int argc, char *argv[]){
-    
-    auto opts=ReadOptions(argc,argv);  //ReadOptions是一个定义的函数
-    
-    //Definining the neural-network wave-function
-    Nqs wavef(opts["filename"]);   //Nqs为新定义的一个class wavef是Nqs类的一个对象
-    
-    int nsweeps=std::stod(opts["nsweeps"]);   //nsweep = 扫描的次数
+//Neighbour exchanges are available only for hamiltonians defined on a set of bonds
+template<class SamplerT,class Hamiltonian> void SetExchangeBonds(SamplerT &,Hamiltonian &){
+    std::cerr<<"# Error : Neighbour exchanges are not available for this model"<<std::endl;
+    std::abort();
+}
+
+template<class SamplerT> void SetExchangeBonds(SamplerT & sampler,Heisenberg2d & hamiltonian){
+    sampler.SetExchangeBonds(hamiltonian.Bonds());
+}
+
+template<class SamplerT> void SetExchangeBonds(SamplerT & sampler,GraphHamiltonian & hamiltonian){
+    sampler.SetExchangeBonds(hamiltonian.Bonds());
+}
+
+//Monte Carlo sampling of the energy
+struct SamplingDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Wf,class Hamiltonian> void operator()(Wf & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);   //nsweep = 扫描的次数
+
+        int seed=std::stoi(opts["seed"]);  //随机数种子
+
+        double thermfactor=std::stod(opts["thermfactor"]);
+
+        //Defining and running the sampler   选择模型后运行sampler
+        Sampler<Wf,Hamiltonian> sampler(wavef,hamiltonian,seed);   //采样函数的参数为选择的波函数，给定的哈密顿量，随机数种子
+
+        if(opts.count("filestates")){
+            sampler.SetFileStates(opts["filestates"]);
+        }
+        if(opts.count("localexchange")){
+            SetExchangeBonds(sampler,hamiltonian);
+        }
+        if(opts.count("mtm")){
+            sampler.SetMultipleTry(std::stoi(opts["mtm"]));
+        }
+
+        sampler.Run(nsweeps,thermfactor);
+    }
+};
+
+//Time evolution after a quench, writing snapshots of the wave-function
+struct TvmcDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Hamiltonian> void operator()(Nqs & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);
+
+        int seed=std::stoi(opts["seed"]);
+
+        Tvmc<Hamiltonian> tvmc(wavef,hamiltonian,std::stoi(opts["nchains"]),seed);
+
+        //snapshots are named as the files in Unitary/
+        std::ostringstream prefix;
+        prefix<<opts["model"]<<"_"<<wavef.Nspins()<<"_";
+        if(opts["model"]!="Graph"){
+            prefix<<opts["quench"]<<"_";
+        }
+        prefix<<wavef.Nhidden()/wavef.Nspins();
+
+        tvmc.Run(nsweeps,std::stod(opts["tvmc"]),std::stod(opts["dtsave"]),prefix.str());
+    }
+};
+
+//Bias introduced by the approximate accuracy tiers of the acceptance ratios
+//on configurations sampled with the exact tier: errors of the log-ratios, fraction of Metropolis decisions
+//that change for the same random number, and shift of the estimated energy for the same seed, with its error
+struct AccuracyValidationDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Hamiltonian> void operator()(Nqs & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);
+
+        //all the tiers are sampled with the same seed, so that their energies differ only by the bias of the tier
+        const int seed=ResolveSeed(std::stoi(opts["seed"]));
+
+        double thermfactor=std::stod(opts["thermfactor"]);
+
+        const int nspins=wavef.Nspins();
+        const int nflips=hamiltonian.MinFlips();
+        const int ntiers=3;
+
+        std::vector<double> maxerr(ntiers,0.),meanerr(ntiers,0.),ndiff(ntiers,0.);
+        double nprop=0;
+
+        //proposals are drawn from a stream independent of the sampler
+        nqs::Philox gen(seed,1,nqs::Philox::kSampler);
+
+        {
+            wavef.SetAccuracy(kAccuracyExact);
+            Sampler<Nqs,Hamiltonian> sampler(wavef,hamiltonian,seed);
+            sampler.Init(nflips);
+            sampler.Thermalize(nsweeps,1,nflips);
+
+            std::vector<int> flips(nflips);
+            std::vector<double> ratios(nspins*ntiers);
+
+            for(int n=0;n<nsweeps;n++){
+                sampler.Sweep(nflips);
+                const std::vector<int> & state=sampler.State();
+
+                for(int tier=0;tier<ntiers;tier++){
+                    wavef.SetAccuracy(tier);
+                    for(int p=0;p<nspins;p++){
+                        //the same proposals are used for all the tiers
+                        ProposalFlips(state,p,nflips,flips);
+                        ratios[tier*nspins+p]=wavef.AcceptRatio(state,flips);
+                    }
+                }
+                //the sampling continues with the exact tier
+                wavef.SetAccuracy(kAccuracyExact);
+
+                for(int p=0;p<nspins;p++){
+                    const double u=gen.Uniform();
+                    const double rexact=ratios[p];
+                    for(int tier=1;tier<ntiers;tier++){
+                        const double r=ratios[tier*nspins+p];
+                        const double err=0.5*std::log(r/rexact);
+                        maxerr[tier]=std::max(maxerr[tier],std::abs(err));
+                        meanerr[tier]+=err;
+                        if((r>u)!=(rexact>u)){
+                            ndiff[tier]+=1;
+                        }
+                    }
+                    nprop+=1;
+                }
+            }
+        }
+
+        //energies obtained with the same seed in each tier
+        //the chains of the tiers diverge after the first changed decision, so the shift from the exact tier
+        //is given with the error of the difference of two independent estimates
+        std::vector<double> energy(ntiers),error(ntiers);
+        for(int tier=0;tier<ntiers;tier++){
+            std::ostringstream log;
+            std::streambuf * coutbuf=std::cout.rdbuf(log.rdbuf());
+
+            wavef.SetAccuracy(tier);
+            Sampler<Nqs,Hamiltonian> sampler(wavef,hamiltonian,seed);
+            sampler.Run(nsweeps,thermfactor);
+            energy[tier]=sampler.EnergyPerSpin();
+            error[tier]=sampler.EnergyError();
+
+            std::cout.rdbuf(coutbuf);
+        }
+        wavef.SetAccuracy(kAccuracyExact);
+
+        std::cout<<"# Validation of the accuracy tiers on "<<long(nprop)<<" proposed moves, seed "<<seed<<std::endl;
+        std::cout<<"# tier  max|dlogPsi|  mean dlogPsi  changed decisions  energy per spin  shift from exact"<<std::endl;
+        for(int tier=0;tier<ntiers;tier++){
+            std::cout<<std::setw(7)<<std::left<<AccuracyName(tier)<<std::right<<std::scientific<<std::setprecision(2);
+            std::cout<<"  "<<maxerr[tier]<<"  "<<std::setw(9)<<meanerr[tier]/nprop<<"  "<<ndiff[tier]/nprop;
+            std::cout<<"  "<<std::setprecision(6)<<energy[tier]<<" +/- "<<std::setprecision(1)<<error[tier];
+            std::cout<<"  "<<std::setprecision(1)<<energy[tier]-energy[0];
+            std::cout<<" +/- "<<((tier==0)?0.:std::sqrt(error[tier]*error[tier]+error[0]*error[0]))<<std::endl;
+        }
+        std::cout<<std::defaultfloat;
+    }
+
+    //p-th proposal on the given state: a single flip of site p, or its exchange with the next antiparallel spin
+    void ProposalFlips(const std::vector<int> & state,int p,int nflips,std::vector<int> & flips){
+        const int nspins=state.size();
+        flips[0]=p;
+        if(nflips==2){
+            int q=(p+1)%nspins;
+            while(state[q]==state[p] && q!=p){
+                q=(q+1)%nspins;
+            }
+            flips[1]=q;
+        }
+    }
+};
+
+//Energies of a window of wave-functions from the configurations sampled with the given one
+struct ReweightDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Hamiltonian> void operator()(Nqs & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);
+
+        int seed=std::stoi(opts["seed"]);
+
+        double thermfactor=std::stod(opts["thermfactor"]);
+
+        Reweighting<Hamiltonian> reweighting(wavef,hamiltonian,std::stod(opts["minessfraction"]));
+
+        std::istringstream files(opts["reweight"]);
+        std::string file;
+        while(std::getline(files,file,',')){
+            if(file.size()>0){
+                reweighting.AddTarget(file);
+            }
+        }
+
+        reweighting.Run(nsweeps,thermfactor,seed);
+    }
+};
+
+//Fidelity of a set of networks with the given one
+//the hamiltonian only sets the Monte Carlo moves (and the thermalization criterion)
+struct FidelityDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Hamiltonian> void operator()(Nqs & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);
+
+        int seed=std::stoi(opts["seed"]);
+
+        double thermfactor=std::stod(opts["thermfactor"]);
+
+        Fidelity<Hamiltonian> fidelity(wavef,hamiltonian,std::stoi(opts["nchains"]),std::stoi(opts["threads"]));
+
+        std::istringstream files(opts["fidelity"]);
+        std::string file;
+        while(std::getline(files,file,',')){
+            if(file.size()>0){
+                fidelity.AddTarget(file);
+            }
+        }
+
+        fidelity.Run(nsweeps,thermfactor,seed);
+    }
+};
+
+//Second Renyi entropy of all the bipartitions of the chain
+struct RenyiDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Hamiltonian> void operator()(Nqs & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);
+
+        int seed=std::stoi(opts["seed"]);
+
+        double thermfactor=std::stod(opts["thermfactor"]);
+
+        Renyi<Hamiltonian> renyi(wavef,hamiltonian,std::stoi(opts["nchains"]),std::stoi(opts["threads"]));
+        renyi.Run(nsweeps,thermfactor,seed);
+    }
+};
+
+//Structure factor and correlation functions
+struct CorrelationsDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Hamiltonian> void operator()(Nqs & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);
+
+        int seed=std::stoi(opts["seed"]);
+
+        double thermfactor=std::stod(opts["thermfactor"]);
+
+        Correlations<Hamiltonian> correlations(wavef,hamiltonian,(opts["model"]=="Heisenberg2d")?2:1,
+                                               opts.count("offdiagonal")>0,opts.count("recycle")>0);
+        correlations.Run(nsweeps,thermfactor,seed);
+    }
+};
+
+//Sampling with blocks of chains advanced in lockstep
+struct LockstepDriver{
+
+    std::map<std::string,std::string> & opts;
+
+    template<class Hamiltonian> void operator()(Nqs & wavef,Hamiltonian & hamiltonian){
+
+        int nsweeps=std::stod(opts["nsweeps"]);
+
+        int seed=std::stoi(opts["seed"]);
+
+        double thermfactor=std::stod(opts["thermfactor"]);
+
+        LockstepChains<Hamiltonian> chains(wavef,hamiltonian,std::stoi(opts["lockstep"]),std::stoi(opts["threads"]));
+        if(opts.count("accuracy")){
+            chains.SetAccuracy(AccuracyFromString(opts["accuracy"]));
+            std::cout<<"# Acceptance ratios evaluated with accuracy tier "<<opts["accuracy"]<<std::endl;
+        }
+        chains.Run(nsweeps,thermfactor,seed);
+    }
+};
+
+//Defines the hamiltonian and runs the driver for a given wave-function
+template<class Wf,class Driver> void RunModel(Wf & wavef,std::map<std::string,std::string> & opts,Driver driver){
+
     int nspins=wavef.Nspins();   //nspins = 可见层的元素个数
-    
+
     //Problem hamiltonian inferred from file name  选择的模型
     std::string model=opts["model"];
-    
-    bool printastes=opts.count("filestates");
-    
-    int seed=std::stoi(opts["seed"]);  //随机数种子
-    
+
     if(model=="Ising1d"){
         double hfield=std::stod(opts["hfield"]);  //定义hfield的大小
         Ising1d hamiltonian(nspins,hfield);  //Ising1d是新定义的一个class ,hamiltonian 为Ising1d的一个对象，参数是napins和hfield
-        
-        //Defining and running the sampler   选择模型后运行sampler
-        Sampler<Nqs,Ising1d> sampler(wavef,hamiltonian,seed);   //采样函数的参数为选择的波函数，给定的哈密顿量，随机数种子
-        if(printastes){
-            sampler.SetFileStates(opts["filestates"]);
-        }
-        sampler.Run(nsweeps);  //只有一个参数nsweeps
+        driver(wavef,hamiltonian);
     }
     else if(model=="Heisenberg1d"){
         double jz=std::stod(opts["jz"]);
         Heisenberg1d hamiltonian(nspins,jz);   //Heisenberg1d是新定义的一个class
-        
-        //Defining and running the sampler
-        Sampler<Nqs,Heisenberg1d> sampler(wavef,hamiltonian,seed);
-        if(printastes){
-            sampler.SetFileStates(opts["filestates"]);
-        }
-        sampler.Run(nsweeps);
+        driver(wavef,hamiltonian);
     }
     else if(model=="Heisenberg2d"){
         double jz=std::stod(opts["jz"]);
         Heisenberg2d hamiltonian(nspins,jz);   //Heisenberg2d是新定义的一个class
-        
-        //Defining and running the sampler
-        Sampler<Nqs,Heisenberg2d> sampler(wavef,hamiltonian,seed);
-        if(printastes){
-            sampler.SetFileStates(opts["filestates"]);
+        driver(wavef,hamiltonian);
+    }
+    else if(model=="Graph"){
+        GraphHamiltonian hamiltonian(opts["graph"]);
+        if(hamiltonian.Nspins()!=nspins){
+            std::cerr<<"# Error : the graph and the wave-function have a different number of spins"<<std::endl;
+            std::abort();
         }
-        sampler.Run(nsweeps);
+        driver(wavef,hamiltonian);
     }
     else{
         std::cerr<<"#The given input file does not correspond to one of the implemented problem hamiltonians";
         std::abort();
     }
+}
+
+//Samples all the files listed in the reference file, and checks them against the reference values
+//with --updatereference the reference file is rewritten with the new results
+int RunRegression(std::map<std::string,std::string> & opts){
+    auto entries=ReadReference(opts["regression"]);
+    const bool update=opts.count("updatereference");
+
+    int status=0;
+    for(auto & entry : entries){
+        std::map<std::string,std::string> fileopts;
+        fileopts["model"]=FindModel(entry.filename);
+        if(fileopts["model"]=="Ising1d"){
+            fileopts["hfield"]=FindCoupling(entry.filename);
+        }
+        else{
+            fileopts["jz"]=FindCoupling(entry.filename);
+        }
+
+        RegressionEntry result=entry;
+
+        //the output of the sampler is not shown
+        std::ostringstream log;
+        std::streambuf * coutbuf=std::cout.rdbuf(log.rdbuf());
+        {
+            Nqs wavef(entry.filename);
+            RunModel(wavef,fileopts,RegressionDriver{result});
+        }
+        std::cout.rdbuf(coutbuf);
+
+        if(update){
+            std::cout<<"# "<<entry.filename<<" : "<<std::scientific<<std::setprecision(6)<<result.energy;
+            std::cout<<" +/- "<<std::setprecision(1)<<result.error;
+            std::cout<<"  "<<result.sweepsps<<" sweeps  "<<result.measps<<" measurements per calibration pass"<<std::endl;
+            std::cout<<std::defaultfloat;
+            entry=result;
+        }
+        else{
+            const int check=CheckRegression(entry,result);
+            if(check==1 || status==0){
+                status=std::max(status,check);
+            }
+        }
+    }
+
+    if(update){
+        WriteReference(opts["regression"],entries);
+        std::cout<<"# Reference file "<<opts["regression"]<<" updated"<<std::endl;
+    }
+    else{
+        std::cout<<"# Regression run "<<((status==0)?"passed":((status==1)?"FAILED (energies)":"FAILED (throughput)"))<<std::endl;
+    }
+    return status;
+}
+
+//Keeps networks in memory and evaluates the configurations sent by the clients
+int RunServer(std::map<std::string,std::string> & opts){
+    AmplitudeServer server(std::stoi(opts["servethreads"]));
+
+    if(opts.count("filename")){
+        const std::string message=server.Load("default",opts["filename"]);
+        if(message.size()>0){
+            std::cerr<<"# Error : Cannot load the network, "<<message<<std::endl;
+            std::abort();
+        }
+    }
+
+    if(opts["serve"]=="-"){
+        server.ServeStdio();
+    }
+    else{
+        server.ServeSocket(opts["serve"]);
+    }
+    return 0;
+}
+
+//Logarithms of the wave-function on the configurations stored in a file, evaluated in blocks
+//text files contain nv spins (+1 or -1) per configuration, as written by --filestates,
+//files with extension .bin contain nv signed bytes per configuration
+//the results are written to FILE.logpsi, as lines "re im" (or pairs of doubles, for binary input)
+//the first configuration of each block is checked against LogVal
+int RunLogVals(std::map<std::string,std::string> & opts){
+    const std::string filename=opts["logvals"];
+    const bool binary=(filename.size()>4 && filename.substr(filename.size()-4)==".bin");
+    const int nthreads=std::stoi(opts["threads"]);
+
+    Nqs wavef(opts["filename"]);
+    const int nv=wavef.Nspins();
+
+    std::ifstream fin(filename.c_str(),binary?std::ios::binary:std::ios::in);
+    if(!fin.good()){
+        std::cerr<<"# Error : Cannot open file "<<filename<<std::endl;
+        std::abort();
+    }
+    std::ofstream fout((filename+".logpsi").c_str(),binary?std::ios::binary:std::ios::out);
+    if(!fout.good()){
+        std::cerr<<"# Error : Cannot open file "<<filename<<".logpsi for writing"<<std::endl;
+        std::abort();
+    }
+    fout<<std::setprecision(17);
+
+    const long blocksize=1L<<16;
+    std::vector<int8_t> states(blocksize*nv);
+    std::vector<std::complex<double> > logvals(blocksize);
+    std::vector<int> state(nv);
+
+    long ntotal=0;
+    double maxdeviation=0;
+    double elapsed=0;
+
+    while(true){
+        long nconf=0;
+        if(binary){
+            fin.read((char *)&states[0],blocksize*nv);
+            const long nread=fin.gcount();
+            if(nread%nv!=0){
+                std::cerr<<"# Error : File "<<filename<<" does not contain a whole number of configurations"<<std::endl;
+                std::abort();
+            }
+            nconf=nread/nv;
+        }
+        else{
+            int spin;
+            while(nconf<blocksize && fin>>spin){
+                for(int v=0;v<nv;v++){
+                    if(v>0 && !(fin>>spin)){
+                        std::cerr<<"# Error : File "<<filename<<" does not contain a whole number of configurations"<<std::endl;
+                        std::abort();
+                    }
+                    states[nconf*nv+v]=int8_t(spin);
+                }
+                nconf++;
+            }
+        }
+        if(nconf==0){
+            break;
+        }
+
+        for(long k=0;k<nconf*nv;k++){
+            if(states[k]!=1 && states[k]!=-1){
+                std::cerr<<"# Error : Spins must be equal to 1 or -1 in file "<<filename<<std::endl;
+                std::abort();
+            }
+        }
+
+        auto start=std::chrono::steady_clock::now();
+        wavef.LogValBatch(&states[0],nconf,&logvals[0],nthreads);
+        elapsed+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+        std::copy(states.begin(),states.begin()+nv,state.begin());
+        maxdeviation=std::max(maxdeviation,std::abs(std::exp(logvals[0]-wavef.LogVal(state))-1.));
+
+        if(binary){
+            fout.write((const char *)&logvals[0],nconf*sizeof(std::complex<double>));
+        }
+        else{
+            for(long c=0;c<nconf;c++){
+                fout<<logvals[c].real()<<" "<<logvals[c].imag()<<"\n";
+            }
+        }
+        ntotal+=nconf;
+
+        if(nconf<blocksize){
+            break;
+        }
+    }
+
+    std::cout<<"# "<<ntotal<<" configurations evaluated in "<<elapsed<<" s ("<<ntotal/std::max(elapsed,1.0e-9)<<" per second)"<<std::endl;
+    std::cout<<"# Results written to "<<filename<<".logpsi"<<std::endl;
+    std::cout<<"# Largest relative deviation from LogVal on the checked configurations : "<<maxdeviation<<std::endl;
+    if(maxdeviation>1.0e-8){
+        std::cerr<<"# Warning : the block evaluation differs from LogVal"<<std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+
+    auto opts=ReadOptions(argc,argv);  //ReadOptions是一个定义的函数
+
+    if(opts.count("regression")){
+        return RunRegression(opts);
+    }
+    
+    if(opts.count("serve")){
+        return RunServer(opts);
+    }
     
+    if(opts.count("logvals")){
+        return RunLogVals(opts);
+    }
+
+    //Definining the neural-network wave-function
+    if(opts.count("tvmc")){
+        //the evolution hamiltonian has the coupling given by --quench
+        opts["hfield"]=opts["quench"];
+        opts["jz"]=opts["quench"];
+
+        Nqs wavef(opts["filename"]);
+        RunModel(wavef,opts,TvmcDriver{opts});
+    }
+    else if(opts.count("symmetric")){
+        //translation-symmetric network imported from the given file
+        NqsSymm wavef(opts["filename"],(opts["model"]=="Heisenberg2d")?2:1);
+        RunModel(wavef,opts,SamplingDriver{opts});
+    }
+    else if(opts.count("projected")){
+        //symmetry-projected network built on the given one
+        NqsProjected wavef(opts["filename"],(opts["model"]=="Heisenberg2d")?2:1,opts["projected"]);
+        RunModel(wavef,opts,SamplingDriver{opts});
+    }
+    else if(opts.count("hiddenthreads")){
+        //hidden units distributed over a pool of threads
+        NqsParallel wavef(opts["filename"],std::stoi(opts["hiddenthreads"]));
+        RunModel(wavef,opts,SamplingDriver{opts});
+    }
+    else if(opts.count("lockstep")){
+        Nqs wavef(opts["filename"]);
+        RunModel(wavef,opts,LockstepDriver{opts});
+    }
+    else if(opts.count("correlations")){
+        Nqs wavef(opts["filename"]);
+        RunModel(wavef,opts,CorrelationsDriver{opts});
+    }
+    else if(opts.count("renyi")){
+        Nqs wavef(opts["filename"]);
+        RunModel(wavef,opts,RenyiDriver{opts});
+    }
+    else if(opts.count("fidelity")){
+        Nqs wavef(opts["filename"]);
+        RunModel(wavef,opts,FidelityDriver{opts});
+    }
+    else if(opts.count("reweight")){
+        Nqs wavef(opts["filename"]);
+        RunModel(wavef,opts,ReweightDriver{opts});
+    }
+    else if(opts.count("validateaccuracy")){
+        Nqs wavef(opts["filename"]);
+        RunModel(wavef,opts,AccuracyValidationDriver{opts});
+    }
+    else{
+        Nqs wavef(opts["filename"]);   //Nqs为新定义的一个class wavef是Nqs类的一个对象
+        if(opts.count("sparsetol")){
+            wavef.SetSparsity(std::stod(opts["sparsetol"]));
+        }
+        if(opts.count("accuracy")){
+            wavef.SetAccuracy(AccuracyFromString(opts["accuracy"]));
+            std::cout<<"# Acceptance ratios evaluated with accuracy tier "<<opts["accuracy"]<<std::endl;
+        }
+        if(opts.count("productratios")){
+            wavef.SetProductRatios(true,std::stoi(opts["productratios"]));
+            std::cout<<"# Ratios evaluated in product form"<<std::endl;
+        }
+        RunModel(wavef,opts,SamplingDriver{opts});
+        if(opts.count("productratios") && std::stoi(opts["productratios"])>0){
+            std::cout<<"# Product-form ratios failing the check against LogPoP : "<<wavef.ProductCheckFailures()<<std::endl;
+        }
+    }
+
 }
@@ -12,7 +12,11 @@
 #include <string>
 #include <complex>
 #include <fstream>
+#include <iomanip>
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <thread>
 #include "nqs_paper.h"
 
 class Nqs{
@@ -35,17 +39,147 @@ class Nqs{
     //look-up tables  查找表
     std::vector<std::complex<double> > Lt_;
     
-    //Useful quantities for safe computation of ln(cosh(x))
-    const double log2_;
+    //scratch space for the evaluation of multiple candidates
+    mutable std::vector<const std::complex<double> *> multirows_;
+    mutable std::vector<double> multicoeffs_;
+    mutable std::vector<int> multistart_;
+    
+    //scratch space for the log-derivatives
+    mutable std::vector<double> tanhre_;
+    mutable std::vector<double> tanhim_;
+    
+    //accuracy tier of the acceptance ratios, and real part of lncosh of the look-up tables
+    //(kept only for the approximate tiers)
+    int accuracy_;
+    std::vector<double> relncosh_;
+    
+    //product-form evaluation of the ratios, see ProductPoP
+    //exp(2W) and exp(-2W) for all the weights (row by row), and p,q of the look-up tables,
+    //stored as separate real and imaginary parts
+    bool product_;
+    std::vector<double> expwre_;
+    std::vector<double> expwim_;
+    std::vector<double> expmwre_;
+    std::vector<double> expmwim_;
+    std::vector<double> pltre_;
+    std::vector<double> pltim_;
+    std::vector<double> qltre_;
+    std::vector<double> qltim_;
+    
+    //every checkevery_ ratios the product form is compared with LogPoP
+    int checkevery_;
+    mutable long nratios_;
+    mutable long ncheckfails_;
+    
+    //sparsity of the parameters, see AnalyseSparsity
+    //weights with modulus larger than sparsetol_ are stored in compressed rows (one row per visible unit),
+    //with their real parts kept separately for real networks
+    //specialized_ selects the specialized kernels in LogVal, LogPoP, InitLt and UpdateLt
+    double sparsetol_;
+    bool specialized_;
+    bool zeroa_;
+    bool real_;
+    double density_;
+    double droppedsum_;
+    std::vector<int> csrstart_;
+    std::vector<int> csrcol_;
+    std::vector<std::complex<double> > csrval_;
+    std::vector<double> csrvalre_;
+    
+    //weights and biases as separate real and imaginary parts (weights row by row, with rows of nhpad_ elements),
+    //used by LogValBatch
+    int nhpad_;
+    std::vector<double> wre_;
+    std::vector<double> wim_;
+    std::vector<double> bre_;
+    std::vector<double> bim_;
+    
+    //scratch space for the thetas in the specialized kernels and in LogPoPSequence
+    mutable std::vector<std::complex<double> > dtheta_;
+    mutable std::vector<double> dthetare_;
+    mutable std::vector<int> touched_;
+    mutable std::vector<char> istouched_;
     
 public:
     
-    Nqs(std::string filename):log2_(std::log(2.)){
+    Nqs(std::string filename){
+        accuracy_=kAccuracyExact;
+        product_=false;
+        checkevery_=0;
+        nratios_=0;
+        ncheckfails_=0;
+        sparsetol_=0;
         LoadParameters(filename);
     }
     
     //computes the logarithm of the wave-function  计算波函数的对数
     inline std::complex<double> LogVal(const std::vector<int> & state)const{
+        if(specialized_){
+            return real_?std::complex<double>(SpecialLogVal<double>(state)):SpecialLogVal<std::complex<double> >(state);
+        }
+        return DenseLogVal(state);
+    }
+    
+    //logarithm of the wave-function on the state of the look-up tables, in O(nv+nh) operations
+    std::complex<double> LogValLt(const std::vector<int> & state)const{
+        std::complex<double> rbm(0.,0.);
+        if(!zeroa_){
+            for(int v=0;v<nv_;v++){
+                rbm+=a_[v]*double(state[v]);
+            }
+        }
+        if(real_){
+            double rbmre=0;
+            for(int h=0;h<nh_;h++){
+                rbmre+=Nqs::lncosh(Lt_[h].real());
+            }
+            return rbm+rbmre;
+        }
+        for(int h=0;h<nh_;h++){
+            rbm+=Nqs::lncosh(Lt_[h]);
+        }
+        return rbm;
+    }
+    
+    //logarithms of the wave-function on a block of nconf configurations, stored one after the other (nv spins each, +1 or -1)
+    //the thetas of the whole block are the matrix product of the configurations with the weights, plus the hidden biases,
+    //computed in tiles of kBatchConfs configurations and kBatchHidden hidden units that stay in cache,
+    //with real and imaginary parts in separate arrays so that the products and lncosh are vectorized
+    //the tiles of configurations are divided among nthreads threads
+    void LogValBatch(const int8_t * states,long nconf,std::complex<double> * logvals,int nthreads=1)const{
+        const long ntiles=(nconf+kBatchConfs-1)/kBatchConfs;
+        nthreads=std::max(1,int(std::min(long(nthreads),ntiles)));
+        
+        if(nthreads==1){
+            LogValTiles(states,nconf,logvals,0,ntiles);
+            return;
+        }
+        
+        std::vector<std::thread> threads;
+        for(int t=0;t<nthreads;t++){
+            threads.push_back(std::thread(&Nqs::LogValTiles,this,states,nconf,logvals,(ntiles*t)/nthreads,(ntiles*(t+1))/nthreads));
+        }
+        for(auto & thread : threads){
+            thread.join();
+        }
+    }
+    
+    //computes the logarithm of Psi(state')/Psi(state)  Psi就是wave-function
+    //where state' is a state with a certain number of flipped spins
+    //the vector "flips" contains the sites to be flipped
+    //look-up tables are used to speed-up the calculation   查找表用于提高计算速度
+    inline std::complex<double> LogPoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        if(flips.size()==0){
+            return 0.;
+        }
+        if(specialized_){
+            return real_?std::complex<double>(SpecialLogPoP<double>(state,flips)):SpecialLogPoP<std::complex<double> >(state,flips);
+        }
+        return DenseLogPoP(state,flips);
+    }
+    
+    //LogVal evaluated with all the parameters, as complex numbers
+    std::complex<double> DenseLogVal(const std::vector<int> & state)const{
         
         std::complex<double> rbm(0.,0.);   //rbm 一个复数
         
@@ -67,11 +201,8 @@ public:
         return rbm;
     }
     
-    //computes the logarithm of Psi(state')/Psi(state)  Psi就是wave-function
-    //where state' is a state with a certain number of flipped spins
-    //the vector "flips" contains the sites to be flipped
-    //look-up tables are used to speed-up the calculation   查找表用于提高计算速度
-    inline std::complex<double> LogPoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+    //LogPoP evaluated with all the parameters, as complex numbers
+    std::complex<double> DenseLogPoP(const std::vector<int> & state,const std::vector<int> & flips)const{
         //函数的返回一个double的复数，参数是state，flips
         if(flips.size()==0){
             return 0.;
@@ -98,22 +229,263 @@ public:
         return logpop;
     }
     
+    //computes the logarithms of Psi(state'_k)/Psi(state'') for several candidates k in a single pass over the hidden units
+    //state'' is obtained flipping the sites in "base" (possibly none) on state,
+    //and state'_k is obtained flipping the sites in "cands[k]" on state''
+    //lncosh of each theta is computed only once, and the weight rows of all the candidates are read together
+    //if ncands>=0 only the first ncands candidates are used, so that the caller can reuse a larger buffer of candidates
+    void LogPoPMulti(const std::vector<int> & state,const std::vector<int> & base,
+                     const std::vector<std::vector<int> > & cands,std::vector<std::complex<double> > & logpops,int ncands=-1)const{
+        
+        if(ncands<0){
+            ncands=cands.size();
+        }
+        logpops.assign(ncands,0.);
+        
+        //gathering the weight rows and spin values of all the flips
+        multirows_.clear();
+        multicoeffs_.clear();
+        multistart_.assign(1,0);
+        
+        for(int k=0;k<ncands;k++){
+            for(const auto & flip : cands[k]){
+                double sf=double(state[flip]);
+                for(const auto & b : base){
+                    if(b==flip){
+                        sf=-sf;
+                    }
+                }
+                logpops[k]-=a_[flip]*2.*sf;
+                multirows_.push_back(&W_[flip][0]);
+                multicoeffs_.push_back(-2.*sf);
+            }
+            multistart_.push_back(multirows_.size());
+        }
+        
+        std::complex<double> basepop(0.,0.);
+        for(const auto & b : base){
+            basepop-=a_[b]*2.*double(state[b]);
+        }
+        
+        for(int h=0;h<nh_;h++){
+            std::complex<double> thetah=Lt_[h];
+            for(const auto & b : base){
+                thetah-=2.*double(state[b])*(W_[b][h]);
+            }
+            const std::complex<double> lnth=Nqs::lncosh(thetah);
+            
+            for(int k=0;k<ncands;k++){
+                if(multistart_[k]==multistart_[k+1]){
+                    continue;
+                }
+                std::complex<double> thetahp=thetah;
+                for(int m=multistart_[k];m<multistart_[k+1];m++){
+                    thetahp+=multicoeffs_[m]*multirows_[m][h];
+                }
+                logpops[k]+=(Nqs::lncosh(thetahp)-lnth);
+            }
+        }
+    }
+    
+    //logarithms of Psi(state'_m)/Psi(state) for m=1..flips.size(), where state'_m is obtained flipping the first m sites of "flips"
+    //the thetas of the growing block of flipped spins are updated incrementally from the look-up tables,
+    //so the whole sequence costs O(flips.size()*nh) operations instead of one LogPoP per block
+    void LogPoPSequence(const std::vector<int> & state,const std::vector<int> & flips,std::vector<std::complex<double> > & logpops)const{
+        const int nseq=flips.size();
+        logpops.resize(nseq);
+        if(nseq==0){
+            return;
+        }
+        
+        if(real_){
+            double * theta=&dthetare_[0];
+            double lnref=0;
+            for(int h=0;h<nh_;h++){
+                theta[h]=Lt_[h].real();
+                lnref+=Nqs::lncosh(theta[h]);
+            }
+            double apop=0;
+            for(int m=0;m<nseq;m++){
+                const int flip=flips[m];
+                const double c=-2.*double(state[flip]);
+                apop+=c*a_[flip].real();
+                const double * w=&wre_[flip*nhpad_];
+                double ln=0;
+                for(int h=0;h<nh_;h++){
+                    theta[h]+=c*w[h];
+                    ln+=Nqs::lncosh(theta[h]);
+                }
+                logpops[m]=apop+ln-lnref;
+            }
+            for(int h=0;h<nh_;h++){
+                theta[h]=0.;
+            }
+            return;
+        }
+        
+        std::complex<double> * theta=&dtheta_[0];
+        std::complex<double> lnref(0.,0.);
+        for(int h=0;h<nh_;h++){
+            theta[h]=Lt_[h];
+            lnref+=Nqs::lncosh(theta[h]);
+        }
+        std::complex<double> apop(0.,0.);
+        for(int m=0;m<nseq;m++){
+            const int flip=flips[m];
+            const double c=-2.*double(state[flip]);
+            apop+=c*a_[flip];
+            std::complex<double> ln(0.,0.);
+            for(int h=0;h<nh_;h++){
+                theta[h]+=c*W_[flip][h];
+                ln+=Nqs::lncosh(theta[h]);
+            }
+            logpops[m]=apop+ln-lnref;
+        }
+        for(int h=0;h<nh_;h++){
+            theta[h]=0.;
+        }
+    }
+    
     //
     inline std::complex<double> PoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        if(product_){
+            return ProductPoP(state,flips);
+        }
         return std::exp(LogPoP(state,flips));  //exp是计算e的x次方的函数
     }
     
+    //Psi(state')/Psi(state) as a product of the ratios cosh(theta')/cosh(theta) of the hidden units
+    //flipping spins s_f on sites f shifts theta by -u, u=2 sum_f s_f W_f, and
+    //cosh(theta-u)/cosh(theta) = cosh(u) - tanh(theta) sinh(u) = p exp(-u) + q exp(u)
+    //with p=(1+tanh(theta))/2 and q=(1-tanh(theta))/2 cached for the current state, and exp(+-2W) tabulated
+    //the exponential form avoids the cancellation between cosh(u) and tanh(theta) sinh(u) for large weights,
+    //and no transcendental function is evaluated in the loop over the hidden units
+    //the product is rescaled by a power of two every 16 factors to avoid overflows and underflows
+    std::complex<double> ProductPoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        if(flips.size()==0){
+            return 1.;
+        }
+        
+        std::complex<double> logprefactor(0.,0.);
+        for(const auto & flip : flips){
+            logprefactor-=a_[flip]*2.*double(state[flip]);
+        }
+        
+        const int nflips=flips.size();
+        const double * pre_h=&pltre_[0];
+        const double * pim_h=&pltim_[0];
+        const double * qre_h=&qltre_[0];
+        const double * qim_h=&qltim_[0];
+        
+        double pre=1.;
+        double pim=0.;
+        int exponent=0;
+        
+        for(int h=0;h<nh_;h++){
+            //exp(-u) and exp(u)
+            double mre=1.,mim=0.,ure=1.,uim=0.;
+            for(int f=0;f<nflips;f++){
+                const int k=flips[f]*nh_+h;
+                const bool up=(state[flips[f]]>0);
+                const double emre=up?expmwre_[k]:expwre_[k];
+                const double emim=up?expmwim_[k]:expwim_[k];
+                const double epre=up?expwre_[k]:expmwre_[k];
+                const double epim=up?expwim_[k]:expmwim_[k];
+                
+                const double nmre=mre*emre-mim*emim;
+                mim=mre*emim+mim*emre;
+                mre=nmre;
+                const double nure=ure*epre-uim*epim;
+                uim=ure*epim+uim*epre;
+                ure=nure;
+            }
+            
+            const double fre=pre_h[h]*mre-pim_h[h]*mim+qre_h[h]*ure-qim_h[h]*uim;
+            const double fim=pre_h[h]*mim+pim_h[h]*mre+qre_h[h]*uim+qim_h[h]*ure;
+            
+            const double npre=pre*fre-pim*fim;
+            pim=pre*fim+pim*fre;
+            pre=npre;
+            
+            if((h&15)==15){
+                Renormalize(pre,pim,exponent);
+            }
+        }
+        
+        std::complex<double> pop=std::exp(logprefactor)*std::complex<double>(std::ldexp(pre,exponent),std::ldexp(pim,exponent));
+        
+        //p and q diverge on the zeros of cosh(theta)
+        if(!std::isfinite(pop.real()) || !std::isfinite(pop.imag())){
+            return std::exp(LogPoP(state,flips));
+        }
+        
+        if(checkevery_>0 && (++nratios_)%checkevery_==0){
+            CheckProductPoP(state,flips,pop);
+        }
+        
+        return pop;
+    }
+    
+    //selects the product-form (true) or the logarithmic (false) evaluation of the ratios
+    //if checkevery>0, one ratio every checkevery is compared with the logarithmic evaluation
+    void SetProductRatios(bool product,int checkevery=0){
+        product_=product;
+        checkevery_=checkevery;
+        if(product_){
+            InitProductTables();
+            if(int(Lt_.size())==nh_){
+                InitProductLt();
+            }
+        }
+    }
+    
+    //number of ratios that failed the comparison with the logarithmic evaluation
+    inline long ProductCheckFailures()const{
+        return ncheckfails_;
+    }
+    
+    //|Psi(state')/Psi(state)|^2, used in the Metropolis test
+    //with the approximate tiers only the real parts of lncosh are evaluated, with polynomial approximations
+    inline double AcceptRatio(const std::vector<int> & state,const std::vector<int> & flips)const{
+        switch(accuracy_){
+            case kAccuracyFast:
+                return FastExp<false>(2.*ApproxLogRatio<false>(state,flips));
+            case kAccuracyCoarse:
+                return FastExp<true>(2.*ApproxLogRatio<true>(state,flips));
+            default:
+                return std::norm(PoP(state,flips));
+        }
+    }
+    
+    //selects the accuracy tier of AcceptRatio
+    void SetAccuracy(int accuracy){
+        accuracy_=accuracy;
+        if(int(Lt_.size())==nh_){
+            InitReLncosh();
+        }
+    }
+    
+    inline int Accuracy()const{
+        return accuracy_;
+    }
+    
     //initialization of the look-up tables  查找表的初始化，函数的参数是state一维整型向量
     void InitLt(const std::vector<int> & state){  //
         Lt_.resize(nh_);    //Lt_是一个一维数组，大小为隐含层的元素个数
         
-        for(int h=0;h<nh_;h++){
-            Lt_[h]=b_[h];
-            for(int v=0;v<nv_;v++){
-                Lt_[h]+=double(state[v])*(W_[v][h]);
-            }
+        if(specialized_){
+            SpecialInitLt(state);
+        }
+        else{
+            DenseInitLt(state);
         }
         
+        if(accuracy_!=kAccuracyExact){
+            InitReLncosh();
+        }
+        if(product_){
+            InitProductLt();
+        }
     }
     
     //updates the look-up tables after spin flips  查找表的更新
@@ -123,13 +495,168 @@ public:
             return;
         }
         
-        for(int h=0;h<nh_;h++){
+        if(specialized_ && real_){
+            for(const auto & flip : flips){
+                const double c=-2.*double(state[flip]);
+                for(int k=csrstart_[flip];k<csrstart_[flip+1];k++){
+                    Lt_[csrcol_[k]]+=c*csrvalre_[k];
+                }
+            }
+        }
+        else if(specialized_){
             for(const auto & flip : flips){
-                Lt_[h]-=2.*double(state[flip])*W_[flip][h];  //就是SM-s12的公式
+                const double c=-2.*double(state[flip]);
+                for(int k=csrstart_[flip];k<csrstart_[flip+1];k++){
+                    Lt_[csrcol_[k]]+=c*csrval_[k];
+                }
+            }
+        }
+        else{
+            for(int h=0;h<nh_;h++){
+                for(const auto & flip : flips){
+                    Lt_[h]-=2.*double(state[flip])*W_[flip][h];  //就是SM-s12的公式
+                }
+            }
+        }
+        
+        if(accuracy_!=kAccuracyExact){
+            InitReLncosh();
+        }
+        if(product_){
+            InitProductLt();
+        }
+    }
+    
+    //number of variational parameters
+    inline int Npar()const{
+        return nv_+nh_+nv_*nh_;
+    }
+    
+    //logarithmic derivatives of the wave-function with respect to the parameters
+    //computed from the look-up tables of the current state, in O(nv*nh) operations
+    //order of the parameters is a, b, W (row by row)
+    //der must point to Npar() contiguous elements, no memory is allocated
+    void DerLog(const std::vector<int> & state,std::complex<double> * der)const{
+        for(int v=0;v<nv_;v++){
+            der[v]=double(state[v]);
+        }
+        
+        //tanh(x+iy) = (sinh(2x) + i sin(2y)) / (cosh(2x) + cos(2y))
+        //evaluated on separate arrays of real and imaginary parts, with q=exp(-2|x|) to avoid overflows,
+        //so that the loop can be vectorized
+        double * thr=&tanhre_[0];
+        double * thi=&tanhim_[0];
+        for(int h=0;h<nh_;h++){
+            thr[h]=Lt_[h].real();
+            thi[h]=Lt_[h].imag();
+        }
+        for(int h=0;h<nh_;h++){
+            const double x=thr[h];
+            const double q=std::exp(-2.*std::abs(x));
+            const double den=1.+q*q+2.*q*std::cos(2.*thi[h]);
+            const double sgn=(x<0)?-1.:1.;
+            thr[h]=sgn*(1.-q*q)/den;
+            thi[h]=2.*q*std::sin(2.*thi[h])/den;
+        }
+        
+        std::complex<double> * derb=der+nv_;
+        for(int h=0;h<nh_;h++){
+            derb[h]=std::complex<double>(thr[h],thi[h]);
+        }
+        
+        std::complex<double> * derw=der+nv_+nh_;
+        for(int v=0;v<nv_;v++){
+            const double sv=double(state[v]);
+            for(int h=0;h<nh_;h++){
+                derw[h]=sv*derb[h];
             }
+            derw+=nh_;
+        }
+    }
+    
+    void DerLog(const std::vector<int> & state,std::vector<std::complex<double> > & der)const{
+        der.resize(Npar());
+        DerLog(state,&der[0]);
+    }
+    
+    //parameters, in the same order used by DerLog
+    void GetParameters(std::vector<std::complex<double> > & pars)const{
+        pars.resize(Npar());
+        
+        std::copy(a_.begin(),a_.end(),pars.begin());
+        std::copy(b_.begin(),b_.end(),pars.begin()+nv_);
+        
+        int k=nv_+nh_;
+        for(int v=0;v<nv_;v++){
+            std::copy(W_[v].begin(),W_[v].end(),pars.begin()+k);
+            k+=nh_;
+        }
+    }
+    
+    //sets the parameters, the look-up tables must be initialized again afterwards
+    void SetParameters(const std::vector<std::complex<double> > & pars){
+        std::copy(pars.begin(),pars.begin()+nv_,a_.begin());
+        std::copy(pars.begin()+nv_,pars.begin()+nv_+nh_,b_.begin());
+        
+        int k=nv_+nh_;
+        for(int v=0;v<nv_;v++){
+            std::copy(pars.begin()+k,pars.begin()+k+nh_,W_[v].begin());
+            k+=nh_;
+        }
+        
+        InitBatchTables();
+        AnalyseSparsity(false);
+        if(product_){
+            InitProductTables();
         }
     }
     
+    //saves the parameters of the wave-function in the format read by LoadParameters
+    void SaveParameters(std::string filename)const{
+        std::ofstream fout(filename.c_str());
+        
+        if(!fout.good()){
+            std::cerr<<"# Error : Cannot open file "<<filename<<" for writing"<<std::endl;
+            std::abort();
+        }
+        
+        fout<<nv_<<std::endl;
+        fout<<nh_<<std::endl;
+        fout<<std::scientific<<std::setprecision(6);
+        
+        for(int i=0;i<nv_;i++){
+            fout<<a_[i]<<std::endl;
+        }
+        for(int j=0;j<nh_;j++){
+            fout<<b_[j]<<std::endl;
+        }
+        for(int i=0;i<nv_;i++){
+            for(int j=0;j<nh_;j++){
+                fout<<W_[i][j]<<std::endl;
+            }
+        }
+    }
+    
+    //checks the content of a file of parameters without loading it, returning false if it is invalid
+    //(LoadParameters aborts on invalid files), the values are read one at a time without being stored
+    static bool ValidParameterFile(std::string filename){
+        std::ifstream fin(filename.c_str());
+        
+        int nv,nh;
+        fin>>nv;
+        fin>>nh;
+        if(!fin.good() || nv<0 || nh<0){
+            return false;
+        }
+        
+        const long npar=long(nv)+long(nh)+long(nv)*long(nh);
+        std::complex<double> value;
+        for(long p=0;p<npar;p++){
+            fin>>value;
+        }
+        return !fin.fail();
+    }
+    
     //loads the parameters of the wave-function from a given file  加载wf的参数
     void LoadParameters(std::string filename){  //将文件名作为参数，读取内容到相应的变量里
         
@@ -151,6 +678,8 @@ public:
         
         a_.resize(nv_);   //将可见层的偏置值数量设为可见层的数量
         b_.resize(nh_);   //将隐含层的偏置值数量设为隐含层的数量
+        tanhre_.resize(nh_);
+        tanhim_.resize(nh_);
         W_.resize(nv_,std::vector<std::complex<double> > (nh_));  //将权值矩阵的行X列设为：可见层X隐含层
         
         for(int i=0;i<nv_;i++){  //将可见层的偏置值放到a_[]中
@@ -173,24 +702,42 @@ public:
         
         std::cout<<"# NQS loaded from file "<<filename<<std::endl;
         std::cout<<"# N_visible = "<<nv_<<"  N_hidden = "<<nh_<<std::endl;
+        
+        InitBatchTables();
+        AnalyseSparsity(true);
+    }
+    
+    //weights with modulus below tol are neglected in the specialized kernels (tol=0 drops only exact zeros)
+    //tol<0 disables the specialized kernels
+    void SetSparsity(double tol){
+        sparsetol_=tol;
+        AnalyseSparsity(true);
+        if(product_){
+            InitProductTables();
+        }
+    }
+    
+    inline bool Specialized()const{
+        return specialized_;
     }
     
     //ln(cos(x)) for real argument
     //for large values of x we use the asymptotic expansion  求双曲余弦函数
-    inline double lncosh(double x)const{
+    //static, since it is shared with the other wave-functions
+    static inline double lncosh(double x){
         const double xp=std::abs(x);
         if(xp<=12.){
             return std::log(std::cosh(xp));
         }
         else{
-            return xp-log2_;
+            return xp-M_LN2;
         }
     }
     
     //ln(cos(x)) for complex argument
     //the modulus is computed by means of the previously defined function
     //for real argument   复数的求双曲余弦函数
-    inline std::complex<double> lncosh(std::complex<double> x)const{
+    static inline std::complex<double> lncosh(std::complex<double> x){
         const double xr=x.real();
         const double xi=x.imag();
         
@@ -206,4 +753,517 @@ public:
         return nv_;
     }
     
+    inline int Nhidden()const{
+        return nh_;
+    }
+    
+    //read-only access to the parameters
+    inline const std::vector<std::vector<std::complex<double> > > & Weights()const{
+        return W_;
+    }
+    
+    inline const std::vector<std::complex<double> > & VisibleBias()const{
+        return a_;
+    }
+    
+    inline const std::vector<std::complex<double> > & HiddenBias()const{
+        return b_;
+    }
+    
+private:
+    
+    //tile sizes of LogValBatch: the thetas of a tile take 32 KB
+    static constexpr int kBatchConfs=32;
+    static constexpr int kBatchHidden=64;
+    
+    //the rows are padded with zeros to a multiple of kBatchHidden
+    void InitBatchTables(){
+        nhpad_=((nh_+kBatchHidden-1)/kBatchHidden)*kBatchHidden;
+        wre_.assign(nv_*nhpad_,0.);
+        wim_.assign(nv_*nhpad_,0.);
+        for(int v=0;v<nv_;v++){
+            for(int h=0;h<nh_;h++){
+                wre_[v*nhpad_+h]=W_[v][h].real();
+                wim_[v*nhpad_+h]=W_[v][h].imag();
+            }
+        }
+        bre_.assign(nhpad_,0.);
+        bim_.assign(nhpad_,0.);
+        for(int h=0;h<nh_;h++){
+            bre_[h]=b_[h].real();
+            bim_[h]=b_[h].imag();
+        }
+    }
+    
+    //adds to the thetas of a tile the product of nc configurations with kBatchHidden columns of the weights w
+    //four configurations are processed together, so that each row of weights is loaded once for all of them,
+    //and the sums are accumulated in local arrays of fixed size, which the compiler vectorizes
+    void ThetaProduct(const int8_t * states,int nc,const double * w,double * theta)const{
+        double acc[4][kBatchHidden];
+        for(int c=0;c<nc;c+=4){
+            const int nb=std::min(4,nc-c);
+            const int8_t * sc=states+c*nv_;
+            for(int j=0;j<kBatchHidden;j++){
+                acc[0][j]=acc[1][j]=acc[2][j]=acc[3][j]=0.;
+            }
+            if(nb==4){
+                for(int v=0;v<nv_;v++){
+                    const double sv0=double(sc[v]);
+                    const double sv1=double(sc[nv_+v]);
+                    const double sv2=double(sc[2*nv_+v]);
+                    const double sv3=double(sc[3*nv_+v]);
+                    const double * wv=w+v*nhpad_;
+                    for(int j=0;j<kBatchHidden;j++){
+                        acc[0][j]+=sv0*wv[j];
+                        acc[1][j]+=sv1*wv[j];
+                        acc[2][j]+=sv2*wv[j];
+                        acc[3][j]+=sv3*wv[j];
+                    }
+                }
+            }
+            else{
+                for(int b=0;b<nb;b++){
+                    for(int v=0;v<nv_;v++){
+                        const double sv=double(sc[b*nv_+v]);
+                        const double * wv=w+v*nhpad_;
+                        for(int j=0;j<kBatchHidden;j++){
+                            acc[b][j]+=sv*wv[j];
+                        }
+                    }
+                }
+            }
+            for(int b=0;b<nb;b++){
+                double * tc=theta+(c+b)*kBatchHidden;
+                for(int j=0;j<kBatchHidden;j++){
+                    tc[j]+=acc[b][j];
+                }
+            }
+        }
+    }
+    
+    //LogValBatch on the tiles [tbegin,tend) of configurations
+    void LogValTiles(const int8_t * states,long nconf,std::complex<double> * logvals,long tbegin,long tend)const{
+        std::vector<double> thre(kBatchConfs*kBatchHidden);
+        std::vector<double> thim(kBatchConfs*kBatchHidden);
+        std::vector<double> sumre(kBatchConfs);
+        std::vector<double> sumim(kBatchConfs);
+        
+        for(long tile=tbegin;tile<tend;tile++){
+            const long c0=tile*kBatchConfs;
+            const int nc=int(std::min(long(kBatchConfs),nconf-c0));
+            const int8_t * tstates=states+c0*nv_;
+            
+            //visible bias
+            for(int c=0;c<nc;c++){
+                std::complex<double> av(0.,0.);
+                if(!zeroa_){
+                    for(int v=0;v<nv_;v++){
+                        av+=a_[v]*double(tstates[c*nv_+v]);
+                    }
+                }
+                sumre[c]=av.real();
+                sumim[c]=av.imag();
+            }
+            
+            for(int h0=0;h0<nh_;h0+=kBatchHidden){
+                const int nhb=std::min(kBatchHidden,nh_-h0);
+                
+                //thetas of the tile
+                for(int c=0;c<nc;c++){
+                    for(int j=0;j<kBatchHidden;j++){
+                        thre[c*kBatchHidden+j]=bre_[h0+j];
+                        thim[c*kBatchHidden+j]=bim_[h0+j];
+                    }
+                }
+                ThetaProduct(tstates,nc,&wre_[h0],&thre[0]);
+                if(!real_){
+                    ThetaProduct(tstates,nc,&wim_[h0],&thim[0]);
+                }
+                
+                //lncosh of the thetas, the imaginary part is arg(cosh(theta)) as in lncosh(std::complex<double>)
+                for(int c=0;c<nc;c++){
+                    const double * tr=&thre[c*kBatchHidden];
+                    const double * ti=&thim[c*kBatchHidden];
+                    double sr=0,si=0;
+                    if(real_){
+                        for(int j=0;j<nhb;j++){
+                            const double ax=std::abs(tr[j]);
+                            sr+=ax-M_LN2+std::log1p(std::exp(-2.*ax));
+                        }
+                    }
+                    else{
+                        for(int j=0;j<nhb;j++){
+                            sr+=ReLncosh(tr[j],ti[j]);
+                            si+=std::atan2(std::tanh(tr[j])*std::sin(ti[j]),std::cos(ti[j]));
+                        }
+                    }
+                    sumre[c]+=sr;
+                    sumim[c]+=si;
+                }
+            }
+            
+            for(int c=0;c<nc;c++){
+                logvals[c0+c]=std::complex<double>(sumre[c],sumim[c]);
+            }
+        }
+    }
+    
+    //minimum fraction of neglected weights for which the compressed rows are reported as sparse
+    static constexpr double kSparseFraction=0.25;
+    
+    //accepted deviation of the specialized kernels from the dense ones, when no weight is neglected
+    static constexpr double kSpecializedCheckTol=1.0e-10;
+    
+    //finds vanishing visible biases, real parameters and weights below sparsetol_,
+    //and builds the compressed rows used by the specialized kernels
+    //the specialized kernels are then compared with the dense ones, and disabled if they disagree
+    void AnalyseSparsity(bool verbose){
+        zeroa_=true;
+        real_=true;
+        for(const auto & a : a_){
+            zeroa_=zeroa_ && (a==0.);
+            real_=real_ && (a.imag()==0);
+        }
+        for(const auto & b : b_){
+            real_=real_ && (b.imag()==0);
+        }
+        for(const auto & wv : W_){
+            for(const auto & w : wv){
+                real_=real_ && (w.imag()==0);
+            }
+        }
+        
+        dtheta_.assign(nh_,0.);
+        dthetare_.assign(nh_,0.);
+        istouched_.assign(nh_,0);
+        touched_.reserve(nh_);
+        
+        specialized_=false;
+        if(sparsetol_<0){
+            if(verbose){
+                std::cout<<"# Dense kernels selected"<<std::endl;
+            }
+            return;
+        }
+        
+        csrstart_.assign(1,0);
+        csrcol_.clear();
+        csrval_.clear();
+        csrvalre_.clear();
+        droppedsum_=0;
+        for(int v=0;v<nv_;v++){
+            for(int h=0;h<nh_;h++){
+                const std::complex<double> w=W_[v][h];
+                if(std::abs(w)<=sparsetol_){
+                    droppedsum_+=std::abs(w);
+                    continue;
+                }
+                csrcol_.push_back(h);
+                csrval_.push_back(w);
+                csrvalre_.push_back(w.real());
+            }
+            csrstart_.push_back(csrcol_.size());
+        }
+        density_=(nv_*nh_>0)?double(csrcol_.size())/double(nv_*nh_):1.;
+        
+        //complex networks with dense weights gain nothing from the compressed rows
+        const bool sparse=(density_<=1.-kSparseFraction);
+        specialized_=(real_ || sparse);
+        
+        if(specialized_){
+            const double deviation=CheckSpecialized();
+            if(deviation>kSpecializedCheckTol+2.*droppedsum_){
+                std::cerr<<"# Warning : specialized kernels differ from the dense ones by "<<deviation<<", dense kernels are used"<<std::endl;
+                specialized_=false;
+            }
+        }
+        
+        if(verbose){
+            std::cout<<"# Parameters : "<<(zeroa_?"zero":"nonzero")<<" visible bias, "<<(real_?"real":"complex");
+            std::cout<<", "<<std::setprecision(3)<<100.*density_<<"% of the weights above "<<sparsetol_<<std::endl;
+            std::cout<<std::setprecision(6);
+            std::cout<<"# "<<(specialized_?"Specialized":"Dense")<<" kernels selected"<<std::endl;
+        }
+    }
+    
+    //largest deviation of the specialized LogVal, InitLt and LogPoP (single flips and neighbouring pairs)
+    //from the dense ones, on a few fixed configurations
+    //the look-up tables are restored afterwards
+    double CheckSpecialized(){
+        std::vector<std::complex<double> > savedlt;
+        savedlt.swap(Lt_);
+        Lt_.resize(nh_);
+        
+        double deviation=0;
+        std::vector<int> state(nv_);
+        std::vector<int> flips;
+        
+        for(int c=0;c<3;c++){
+            for(int v=0;v<nv_;v++){
+                state[v]=(((v+c)*(v+2*c+1))%3==0)?1:-1;
+            }
+            
+            const std::complex<double> logval=DenseLogVal(state);
+            const std::complex<double> speciallogval=real_?std::complex<double>(SpecialLogVal<double>(state)):SpecialLogVal<std::complex<double> >(state);
+            deviation=std::max(deviation,std::abs(std::exp(speciallogval-logval)-1.));
+            
+            SpecialInitLt(state);
+            std::vector<std::complex<double> > speciallt(Lt_);
+            DenseInitLt(state);
+            for(int h=0;h<nh_;h++){
+                deviation=std::max(deviation,std::abs(speciallt[h]-Lt_[h]));
+            }
+            
+            for(int v=0;v<nv_;v++){
+                for(int nflips=1;nflips<=std::min(2,nv_);nflips++){
+                    flips.resize(nflips);
+                    for(int f=0;f<nflips;f++){
+                        flips[f]=(v+f)%nv_;
+                    }
+                    const std::complex<double> logpop=DenseLogPoP(state,flips);
+                    const std::complex<double> speciallogpop=real_?std::complex<double>(SpecialLogPoP<double>(state,flips)):SpecialLogPoP<std::complex<double> >(state,flips);
+                    deviation=std::max(deviation,std::abs(std::exp(speciallogpop-logpop)-1.));
+                }
+            }
+        }
+        
+        Lt_.swap(savedlt);
+        return deviation;
+    }
+    
+    void DenseInitLt(const std::vector<int> & state){
+        for(int h=0;h<nh_;h++){
+            Lt_[h]=b_[h];
+            for(int v=0;v<nv_;v++){
+                Lt_[h]+=double(state[v])*(W_[v][h]);
+            }
+        }
+    }
+    
+    void SpecialInitLt(const std::vector<int> & state){
+        for(int h=0;h<nh_;h++){
+            Lt_[h]=b_[h];
+        }
+        for(int v=0;v<nv_;v++){
+            const double sv=double(state[v]);
+            for(int k=csrstart_[v];k<csrstart_[v+1];k++){
+                Lt_[csrcol_[k]]+=sv*csrval_[k];
+            }
+        }
+    }
+    
+    //accessors used by the specialized kernels, which are instantiated with T=double for real networks
+    //and T=std::complex<double> otherwise
+    static inline double Value(std::complex<double> z,double){
+        return z.real();
+    }
+    static inline std::complex<double> Value(std::complex<double> z,std::complex<double>){
+        return z;
+    }
+    inline const double * CsrValues(double)const{
+        return &csrvalre_[0];
+    }
+    inline const std::complex<double> * CsrValues(std::complex<double>)const{
+        return &csrval_[0];
+    }
+    inline double * DTheta(double)const{
+        return &dthetare_[0];
+    }
+    inline std::complex<double> * DTheta(std::complex<double>)const{
+        return &dtheta_[0];
+    }
+    
+    //LogVal without the vanishing visible biases and neglected weights
+    template<class T> T SpecialLogVal(const std::vector<int> & state)const{
+        T rbm=0.;
+        if(!zeroa_){
+            for(int v=0;v<nv_;v++){
+                rbm+=Value(a_[v],T())*double(state[v]);
+            }
+        }
+        
+        const T * val=CsrValues(T());
+        T * theta=DTheta(T());
+        for(int h=0;h<nh_;h++){
+            theta[h]=Value(b_[h],T());
+        }
+        for(int v=0;v<nv_;v++){
+            const double sv=double(state[v]);
+            for(int k=csrstart_[v];k<csrstart_[v+1];k++){
+                theta[csrcol_[k]]+=sv*val[k];
+            }
+        }
+        for(int h=0;h<nh_;h++){
+            rbm+=Nqs::lncosh(theta[h]);
+            theta[h]=0.;
+        }
+        return rbm;
+    }
+    
+    //LogPoP restricted to the hidden units connected to the flipped spins
+    template<class T> T SpecialLogPoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        T logpop=0.;
+        if(!zeroa_){
+            for(const auto & flip : flips){
+                logpop-=Value(a_[flip],T())*2.*double(state[flip]);
+            }
+        }
+        
+        const T * val=CsrValues(T());
+        
+        if(flips.size()==1){
+            const int flip=flips[0];
+            const double c=-2.*double(state[flip]);
+            for(int k=csrstart_[flip];k<csrstart_[flip+1];k++){
+                const T thetah=Value(Lt_[csrcol_[k]],T());
+                logpop+=(Nqs::lncosh(thetah+c*val[k])-Nqs::lncosh(thetah));
+            }
+            return logpop;
+        }
+        
+        //changes of the thetas accumulated on the hidden units touched by any flip
+        T * dtheta=DTheta(T());
+        touched_.clear();
+        for(const auto & flip : flips){
+            const double c=-2.*double(state[flip]);
+            for(int k=csrstart_[flip];k<csrstart_[flip+1];k++){
+                const int h=csrcol_[k];
+                if(!istouched_[h]){
+                    istouched_[h]=1;
+                    touched_.push_back(h);
+                }
+                dtheta[h]+=c*val[k];
+            }
+        }
+        for(const auto & h : touched_){
+            const T thetah=Value(Lt_[h],T());
+            logpop+=(Nqs::lncosh(thetah+dtheta[h])-Nqs::lncosh(thetah));
+            dtheta[h]=0.;
+            istouched_[h]=0;
+        }
+        return logpop;
+    }
+    
+    //real part of log(Psi(state')/Psi(state)), with the approximate lncosh
+    //with the specialized kernels only the hidden units connected to the flipped spins by the compressed rows change,
+    //consistently with the look-up tables
+    template<bool coarse> inline double ApproxLogRatio(const std::vector<int> & state,const std::vector<int> & flips)const{
+        double logr=0;
+        for(const auto & flip : flips){
+            logr-=a_[flip].real()*2.*double(state[flip]);
+        }
+        
+        if(specialized_){
+            std::complex<double> * dtheta=DTheta(std::complex<double>());
+            touched_.clear();
+            for(const auto & flip : flips){
+                const double c=-2.*double(state[flip]);
+                for(int k=csrstart_[flip];k<csrstart_[flip+1];k++){
+                    const int h=csrcol_[k];
+                    if(!istouched_[h]){
+                        istouched_[h]=1;
+                        touched_.push_back(h);
+                    }
+                    dtheta[h]+=c*csrval_[k];
+                }
+            }
+            for(const auto & h : touched_){
+                const std::complex<double> thetahp=Lt_[h]+dtheta[h];
+                logr+=FastReLncosh<coarse>(thetahp.real(),thetahp.imag())-relncosh_[h];
+                dtheta[h]=0.;
+                istouched_[h]=0;
+            }
+            return logr;
+        }
+        
+        for(int h=0;h<nh_;h++){
+            std::complex<double> thetahp=Lt_[h];
+            for(const auto & flip : flips){
+                thetahp-=2.*double(state[flip])*W_[flip][h];
+            }
+            logr+=FastReLncosh<coarse>(thetahp.real(),thetahp.imag())-relncosh_[h];
+        }
+        return logr;
+    }
+    
+    //exp(2W) and exp(-2W) of all the weights
+    //with the specialized kernels the weights dropped from the compressed rows are zero, as in the look-up tables
+    void InitProductTables(){
+        expwre_.resize(nv_*nh_);
+        expwim_.resize(nv_*nh_);
+        expmwre_.resize(nv_*nh_);
+        expmwim_.resize(nv_*nh_);
+        for(int v=0;v<nv_;v++){
+            for(int h=0;h<nh_;h++){
+                SetProductWeight(v,h,specialized_?std::complex<double>(0.):W_[v][h]);
+            }
+        }
+        if(specialized_){
+            for(int v=0;v<nv_;v++){
+                for(int k=csrstart_[v];k<csrstart_[v+1];k++){
+                    SetProductWeight(v,csrcol_[k],csrval_[k]);
+                }
+            }
+        }
+    }
+    
+    inline void SetProductWeight(int v,int h,std::complex<double> w){
+        const std::complex<double> ep=std::exp(2.*w);
+        const std::complex<double> em=std::exp(-2.*w);
+        expwre_[v*nh_+h]=ep.real();
+        expwim_[v*nh_+h]=ep.imag();
+        expmwre_[v*nh_+h]=em.real();
+        expmwim_[v*nh_+h]=em.imag();
+    }
+    
+    //p=1/(1+exp(-2 theta)) and q=1/(1+exp(2 theta)), computed without overflows
+    void InitProductLt(){
+        pltre_.resize(nh_);
+        pltim_.resize(nh_);
+        qltre_.resize(nh_);
+        qltim_.resize(nh_);
+        for(int h=0;h<nh_;h++){
+            std::complex<double> p,q;
+            if(Lt_[h].real()>=0){
+                const std::complex<double> z=std::exp(-2.*Lt_[h]);
+                p=1./(1.+z);
+                q=z*p;
+            }
+            else{
+                const std::complex<double> z=std::exp(2.*Lt_[h]);
+                q=1./(1.+z);
+                p=z*q;
+            }
+            pltre_[h]=p.real();
+            pltim_[h]=p.imag();
+            qltre_[h]=q.real();
+            qltim_[h]=q.imag();
+        }
+    }
+    
+    //divides the product by the power of two closest to its modulus, keeping track of the exponent
+    static inline void Renormalize(double & pre,double & pim,int & exponent){
+        int e;
+        std::frexp(std::max(std::abs(pre),std::abs(pim)),&e);
+        pre=std::ldexp(pre,-e);
+        pim=std::ldexp(pim,-e);
+        exponent+=e;
+    }
+    
+    void CheckProductPoP(const std::vector<int> & state,const std::vector<int> & flips,std::complex<double> pop)const{
+        const std::complex<double> ref=std::exp(LogPoP(state,flips));
+        const double relerr=std::abs(pop-ref)/std::max(std::abs(ref),1.0e-300);
+        if(relerr>1.0e-8){
+            ncheckfails_++;
+            std::cerr<<"# Warning : product-form ratio differs from LogPoP, relative error "<<relerr<<std::endl;
+        }
+    }
+    
+    void InitReLncosh(){
+        relncosh_.resize(nh_);
+        for(int h=0;h<nh_;h++){
+            relncosh_[h]=ReLncosh(Lt_[h],accuracy_);
+        }
+    }
+    
 };
@@ -7,9 +7,26 @@
 //
 
 #include <string>
+#include "../philox.hh"
 #include "readoptions.cpp"
+#include "fastmath.cpp"
 #include "nqs.cpp"
+#include "fft.cpp"
+#include "nqssymm.cpp"
+#include "nqsprojected.cpp"
+#include "nqsparallel.cpp"
 #include "ising1d.cpp"
 #include "heisenberg1d.cpp"
 #include "heisenberg2d.cpp"
+#include "graphhamiltonian.cpp"
+#include "statistics.cpp"
 #include "sampler.cpp"
+#include "exact.cpp"
+#include "regression.cpp"
+#include "tvmc.cpp"
+#include "reweight.cpp"
+#include "fidelity.cpp"
+#include "renyi.cpp"
+#include "correlations.cpp"
+#include "lockstep.cpp"
+#include "server.cpp"
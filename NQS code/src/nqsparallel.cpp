@@ -0,0 +1,386 @@
+//
+//  nqsparallel.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <complex>
+#include <thread>
+#include <atomic>
+#include <pthread.h>
+#include "nqs_paper.h"
+
+//Neural-network quantum state with the hidden units partitioned among a pool of threads
+//Each worker is pinned to a core and owns its slice of the weights, hidden biases and look-up tables,
+//which are allocated by the worker itself so that they reside in its cache/NUMA node
+//The calling thread works on slice 0, and partial results are reduced in a fixed order,
+//so results do not depend on the timing of the workers
+class NqsParallel{
+
+    //part of the network owned by one worker
+    struct Slice{
+        //first hidden unit and number of hidden units
+        int h0;
+        int nh;
+
+        //weights, W[v*nh+h] couples visible unit v to hidden unit h0+h
+        std::vector<std::complex<double> > W;
+        std::vector<std::complex<double> > b;
+        std::vector<std::complex<double> > Lt;
+
+        //partial results of the last job
+        std::complex<double> res;
+        std::vector<std::complex<double> > multires;
+
+        //keeps the partial results of different workers on different cache lines
+        char pad[64];
+    };
+
+    //jobs executed by the workers
+    enum Job{kNone,kInitLt,kLogVal,kLogPoP,kUpdateLt,kLogPoPMulti,kStop};
+
+    int nv_;
+    int nh_;
+    const int nthreads_;
+
+    //visible bias, handled by the calling thread
+    std::vector<std::complex<double> > a_;
+
+    std::vector<Slice> slices_;
+    std::vector<std::thread> workers_;
+
+    //job description, written by the calling thread before incrementing generation_
+    Job job_;
+    const std::vector<int> * jobstate_;
+    const std::vector<int> * jobflips_;
+    const std::vector<int> * jobbase_;
+    const std::vector<std::vector<int> > * jobcands_;
+
+    //job counter, and number of workers that completed the current job
+    std::atomic<int> generation_;
+    std::atomic<int> done_;
+
+public:
+
+    NqsParallel(std::string filename,int nthreads):nthreads_(nthreads),generation_(0),done_(0){
+        if(nthreads_<1){
+            std::cerr<<"# Error : The number of threads should be at least 1"<<std::endl;
+            std::abort();
+        }
+        LoadParameters(filename);
+    }
+
+    NqsParallel(const NqsParallel & other)=delete;
+
+    ~NqsParallel(){
+        Dispatch(kStop);
+        for(auto & worker : workers_){
+            worker.join();
+        }
+    }
+
+    //computes the logarithm of the wave-function
+    std::complex<double> LogVal(const std::vector<int> & state){
+        jobstate_=&state;
+        Dispatch(kLogVal);
+
+        std::complex<double> rbm(0.,0.);
+        for(int v=0;v<nv_;v++){
+            rbm+=a_[v]*double(state[v]);
+        }
+        return rbm+Reduce();
+    }
+
+    //computes the logarithm of Psi(state')/Psi(state)
+    //where state' is obtained flipping the sites in "flips"
+    std::complex<double> LogPoP(const std::vector<int> & state,const std::vector<int> & flips){
+        if(flips.size()==0){
+            return 0.;
+        }
+
+        jobstate_=&state;
+        jobflips_=&flips;
+        Dispatch(kLogPoP);
+
+        std::complex<double> logpop(0.,0.);
+        for(const auto & flip : flips){
+            logpop-=a_[flip]*2.*double(state[flip]);
+        }
+        return logpop+Reduce();
+    }
+
+    //same as Nqs::LogPoPMulti
+    void LogPoPMulti(const std::vector<int> & state,const std::vector<int> & base,
+                     const std::vector<std::vector<int> > & cands,std::vector<std::complex<double> > & logpops){
+        jobstate_=&state;
+        jobbase_=&base;
+        jobcands_=&cands;
+        Dispatch(kLogPoPMulti);
+
+        const int ncands=cands.size();
+        logpops.assign(ncands,0.);
+        for(int k=0;k<ncands;k++){
+            for(const auto & flip : cands[k]){
+                double sf=double(state[flip]);
+                for(const auto & b : base){
+                    if(b==flip){
+                        sf=-sf;
+                    }
+                }
+                logpops[k]-=a_[flip]*2.*sf;
+            }
+            for(const auto & slice : slices_){
+                logpops[k]+=slice.multires[k];
+            }
+        }
+    }
+
+    inline std::complex<double> PoP(const std::vector<int> & state,const std::vector<int> & flips){
+        return std::exp(LogPoP(state,flips));
+    }
+    
+    //|Psi(state')/Psi(state)|^2, used in the Metropolis test (always computed exactly)
+    inline double AcceptRatio(const std::vector<int> & state,const std::vector<int> & flips){
+        return std::norm(PoP(state,flips));
+    }
+
+    //initialization of the look-up tables
+    void InitLt(const std::vector<int> & state){
+        jobstate_=&state;
+        Dispatch(kInitLt);
+    }
+
+    //updates the look-up tables after spin flips
+    void UpdateLt(const std::vector<int> & state,const std::vector<int> & flips){
+        if(flips.size()==0){
+            return;
+        }
+        jobstate_=&state;
+        jobflips_=&flips;
+        Dispatch(kUpdateLt);
+    }
+
+    //loads the parameters from a file in the format of Nqs, and starts the workers
+    void LoadParameters(std::string filename){
+        Nqs dense(filename);
+
+        nv_=dense.Nspins();
+        nh_=dense.Nhidden();
+        a_=dense.VisibleBias();
+
+        slices_.resize(nthreads_);
+        for(int t=0;t<nthreads_;t++){
+            slices_[t].h0=(nh_*t)/nthreads_;
+            slices_[t].nh=(nh_*(t+1))/nthreads_-slices_[t].h0;
+        }
+
+        //the slice of each worker is allocated and filled by the worker itself
+        std::atomic<int> ready(0);
+        for(int t=1;t<nthreads_;t++){
+            workers_.push_back(std::thread([this,t,&dense,&ready](){
+                Pin(t);
+                FillSlice(slices_[t],dense);
+                ready++;
+                WorkerLoop(t);
+            }));
+        }
+        Pin(0);
+        FillSlice(slices_[0],dense);
+        while(ready.load()<nthreads_-1){
+            std::this_thread::yield();
+        }
+
+        std::cout<<"# Hidden units distributed over "<<nthreads_<<" threads"<<std::endl;
+    }
+
+    //total number of spins
+    inline int Nspins()const{
+        return nv_;
+    }
+
+    inline int Nhidden()const{
+        return nh_;
+    }
+
+private:
+
+    void FillSlice(Slice & slice,const Nqs & dense){
+        const auto & W=dense.Weights();
+        const auto & b=dense.HiddenBias();
+
+        slice.W.resize(nv_*slice.nh);
+        slice.b.resize(slice.nh);
+        slice.Lt.resize(slice.nh);
+
+        for(int h=0;h<slice.nh;h++){
+            slice.b[h]=b[slice.h0+h];
+        }
+        for(int v=0;v<nv_;v++){
+            for(int h=0;h<slice.nh;h++){
+                slice.W[v*slice.nh+h]=W[v][slice.h0+h];
+            }
+        }
+    }
+
+    //pins the calling thread to a core
+    void Pin(int t){
+        const int ncores=std::thread::hardware_concurrency();
+        if(ncores<=0){
+            return;
+        }
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(t%ncores,&cpuset);
+        pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&cpuset);
+    }
+
+    //runs a job on all the slices, and waits for its completion
+    void Dispatch(Job job){
+        job_=job;
+        done_.store(0);
+        generation_.fetch_add(1);
+
+        if(job!=kStop){
+            RunJob(slices_[0]);
+        }
+
+        int spins=0;
+        while(done_.load()<nthreads_-1){
+            if(++spins>4096){
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void WorkerLoop(int t){
+        int seen=0;
+        while(true){
+            //spinning on the job counter, yielding when no job is coming
+            int spins=0;
+            while(generation_.load()==seen){
+                if(++spins>4096){
+                    std::this_thread::yield();
+                }
+            }
+            seen++;
+
+            const bool stop=(job_==kStop);
+            if(!stop){
+                RunJob(slices_[t]);
+            }
+            done_.fetch_add(1);
+
+            if(stop){
+                return;
+            }
+        }
+    }
+
+    //sum of the partial results in a fixed order
+    std::complex<double> Reduce()const{
+        std::complex<double> res(0.,0.);
+        for(const auto & slice : slices_){
+            res+=slice.res;
+        }
+        return res;
+    }
+
+    void RunJob(Slice & slice){
+        const int nh=slice.nh;
+        const std::vector<int> & state=*jobstate_;
+
+        switch(job_){
+            case kInitLt:
+                for(int h=0;h<nh;h++){
+                    slice.Lt[h]=slice.b[h];
+                }
+                for(int v=0;v<nv_;v++){
+                    const double sv=double(state[v]);
+                    const std::complex<double> * wv=&slice.W[v*nh];
+                    for(int h=0;h<nh;h++){
+                        slice.Lt[h]+=sv*wv[h];
+                    }
+                }
+                break;
+
+            case kLogVal:{
+                std::vector<std::complex<double> > theta(slice.b);
+                for(int v=0;v<nv_;v++){
+                    const double sv=double(state[v]);
+                    const std::complex<double> * wv=&slice.W[v*nh];
+                    for(int h=0;h<nh;h++){
+                        theta[h]+=sv*wv[h];
+                    }
+                }
+                slice.res=0.;
+                for(int h=0;h<nh;h++){
+                    slice.res+=Nqs::lncosh(theta[h]);
+                }
+                break;
+            }
+
+            case kLogPoP:{
+                const std::vector<int> & flips=*jobflips_;
+                slice.res=0.;
+                for(int h=0;h<nh;h++){
+                    const std::complex<double> thetah=slice.Lt[h];
+                    std::complex<double> thetahp=thetah;
+                    for(const auto & flip : flips){
+                        thetahp-=2.*double(state[flip])*slice.W[flip*nh+h];
+                    }
+                    slice.res+=(Nqs::lncosh(thetahp)-Nqs::lncosh(thetah));
+                }
+                break;
+            }
+
+            case kUpdateLt:
+                for(const auto & flip : *jobflips_){
+                    const double sf=2.*double(state[flip]);
+                    const std::complex<double> * wf=&slice.W[flip*nh];
+                    for(int h=0;h<nh;h++){
+                        slice.Lt[h]-=sf*wf[h];
+                    }
+                }
+                break;
+
+            case kLogPoPMulti:{
+                const std::vector<int> & base=*jobbase_;
+                const std::vector<std::vector<int> > & cands=*jobcands_;
+                const int ncands=cands.size();
+                slice.multires.assign(ncands,0.);
+
+                for(int h=0;h<nh;h++){
+                    std::complex<double> thetah=slice.Lt[h];
+                    for(const auto & b : base){
+                        thetah-=2.*double(state[b])*slice.W[b*nh+h];
+                    }
+                    const std::complex<double> lnth=Nqs::lncosh(thetah);
+
+                    for(int k=0;k<ncands;k++){
+                        if(cands[k].size()==0){
+                            continue;
+                        }
+                        std::complex<double> thetahp=thetah;
+                        for(const auto & flip : cands[k]){
+                            double sf=double(state[flip]);
+                            for(const auto & b : base){
+                                if(b==flip){
+                                    sf=-sf;
+                                }
+                            }
+                            thetahp-=2.*sf*slice.W[flip*nh+h];
+                        }
+                        slice.multires[k]+=(Nqs::lncosh(thetahp)-lnth);
+                    }
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+};
@@ -0,0 +1,424 @@
+//
+//  nqsprojected.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <complex>
+#include <algorithm>
+#include "nqs_paper.h"
+
+//Symmetry-projected neural-network quantum state Psi_sym(state) = sum_g Psi(g.state)
+//built on a dense (non-symmetric) network Psi, on a periodic chain (dim=1) or a periodic square lattice (dim=2)
+//the group contains the translations ('t'), the reflections ('r') and the global spin flip ('z') selected in the
+//given string, and the image g.state has spins (g.state)(i) = z_g*state(p_g(i))
+//one table of thetas is kept for each image: a flip of site j changes only the site p_g^-1(j) of image g,
+//so LogPoP and UpdateLt cost O(|G|*nh) operations per flipped site
+class NqsProjected{
+
+    //weights W_[i*nh_+h], visible and hidden biases of the dense network
+    std::vector<std::complex<double> > W_;
+    std::vector<std::complex<double> > a_;
+    std::vector<std::complex<double> > b_;
+
+    //all the parameters are real, and the real parts of the weights
+    bool real_;
+    std::vector<double> Wre_;
+
+    //number of visible and hidden units
+    int nv_;
+    int nh_;
+
+    //linear size and dimension of the lattice
+    int l_;
+    const int dim_;
+
+    //number of symmetry operations
+    int ng_;
+
+    //site permutations perm_[g*nv_+i]=p_g(i), their inverses, and spin flip z_g of each operation
+    std::vector<int> perm_;
+    std::vector<int> inv_;
+    std::vector<double> zflip_;
+
+    //look-up tables of each image, Lt_[g*nh_+h]=theta_h(g.state) (Ltre_ for real networks)
+    std::vector<std::complex<double> > Lt_;
+    std::vector<double> Ltre_;
+
+    //visible bias term and log-amplitude of each image, and log of Psi_sym
+    std::vector<std::complex<double> > vbias_;
+    std::vector<std::complex<double> > logimage_;
+    std::complex<double> logpsi_;
+
+    mutable std::vector<std::complex<double> > logimagep_;
+    mutable std::vector<int> rows_;
+    mutable std::vector<double> coeffs_;
+
+public:
+
+    //imports the dense network from the given file, and builds the group described by "group"
+    NqsProjected(std::string filename,int dim,std::string group):dim_(dim){
+        LoadParameters(filename);
+        BuildGroup(group);
+    }
+
+    //computes the logarithm of the wave-function
+    std::complex<double> LogVal(const std::vector<int> & state)const{
+        std::vector<std::complex<double> > logimage(ng_);
+
+        for(int g=0;g<ng_;g++){
+            const int * p=&perm_[g*nv_];
+            std::complex<double> rbm=0.;
+            for(int i=0;i<nv_;i++){
+                rbm+=a_[i]*zflip_[g]*double(state[p[i]]);
+            }
+            for(int h=0;h<nh_;h++){
+                std::complex<double> thetah=b_[h];
+                for(int i=0;i<nv_;i++){
+                    thetah+=W_[i*nh_+h]*zflip_[g]*double(state[p[i]]);
+                }
+                rbm+=Nqs::lncosh(thetah);
+            }
+            logimage[g]=rbm;
+        }
+
+        return LogSum(logimage);
+    }
+
+    //computes the logarithm of Psi_sym(state')/Psi_sym(state)
+    //where state' is obtained from state flipping the sites in "flips"
+    std::complex<double> LogPoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        if(flips.size()==0){
+            return 0.;
+        }
+
+        for(int g=0;g<ng_;g++){
+            logimagep_[g]=real_?std::complex<double>(LogImageP<double>(g,state,flips)):LogImageP<std::complex<double> >(g,state,flips);
+        }
+
+        return LogSum(logimagep_)-logpsi_;
+    }
+
+    //computes the logarithms of Psi_sym(state'_k)/Psi_sym(state'') for several candidates k
+    //where state'' is obtained flipping "base" on state, and state'_k flipping "cands[k]" on state''
+    void LogPoPMulti(const std::vector<int> & state,const std::vector<int> & base,
+                     const std::vector<std::vector<int> > & cands,std::vector<std::complex<double> > & logpops)const{
+        const std::complex<double> logbase=LogPoP(state,base);
+
+        std::vector<int> flips;
+        logpops.resize(cands.size());
+        for(int k=0;k<int(cands.size());k++){
+            //flipping a site twice leaves it unchanged
+            flips=base;
+            for(const auto & flip : cands[k]){
+                auto it=std::find(flips.begin(),flips.end(),flip);
+                if(it==flips.end()){
+                    flips.push_back(flip);
+                }
+                else{
+                    flips.erase(it);
+                }
+            }
+            logpops[k]=LogPoP(state,flips)-logbase;
+        }
+    }
+
+    inline std::complex<double> PoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        return std::exp(LogPoP(state,flips));
+    }
+
+    //|Psi_sym(state')/Psi_sym(state)|^2, used in the Metropolis test
+    inline double AcceptRatio(const std::vector<int> & state,const std::vector<int> & flips)const{
+        return std::norm(PoP(state,flips));
+    }
+
+    //initialization of the look-up tables of all the images
+    void InitLt(const std::vector<int> & state){
+        Lt_.resize(real_?0:ng_*nh_);
+        Ltre_.resize(real_?ng_*nh_:0);
+        vbias_.resize(ng_);
+        logimage_.resize(ng_);
+
+        for(int g=0;g<ng_;g++){
+            if(real_){
+                InitImage<double>(g,state);
+            }
+            else{
+                InitImage<std::complex<double> >(g,state);
+            }
+        }
+        logpsi_=LogSum(logimage_);
+    }
+
+    //updates the look-up tables after spin flips
+    //the flip of site j changes the site p_g^-1(j) of each image g
+    void UpdateLt(const std::vector<int> & state,const std::vector<int> & flips){
+        if(flips.size()==0){
+            return;
+        }
+
+        for(int g=0;g<ng_;g++){
+            if(real_){
+                UpdateImage<double>(g,state,flips);
+            }
+            else{
+                UpdateImage<std::complex<double> >(g,state,flips);
+            }
+        }
+        logpsi_=LogSum(logimage_);
+    }
+
+    //total number of spins
+    inline int Nspins()const{
+        return nv_;
+    }
+
+    inline int Nhidden()const{
+        return nh_;
+    }
+
+    //number of symmetry operations
+    inline int GroupSize()const{
+        return ng_;
+    }
+
+private:
+
+    void LoadParameters(std::string filename){
+        Nqs dense(filename);
+
+        nv_=dense.Nspins();
+        nh_=dense.Nhidden();
+
+        if(dim_==1){
+            l_=nv_;
+        }
+        else{
+            l_=std::sqrt(double(nv_));
+            if(l_*l_!=nv_){
+                std::cerr<<"# Error , the number of spins is not compabitle with a square lattice "<<std::endl;
+                std::abort();
+            }
+        }
+
+        const auto & W=dense.Weights();
+        a_=dense.VisibleBias();
+        b_=dense.HiddenBias();
+
+        W_.resize(nv_*nh_);
+        Wre_.resize(nv_*nh_);
+        real_=true;
+        for(int i=0;i<nv_;i++){
+            for(int h=0;h<nh_;h++){
+                W_[i*nh_+h]=W[i][h];
+                Wre_[i*nh_+h]=W[i][h].real();
+                real_=real_ && (W[i][h].imag()==0);
+            }
+            real_=real_ && (a_[i].imag()==0);
+        }
+        for(int h=0;h<nh_;h++){
+            real_=real_ && (b_[h].imag()==0);
+        }
+    }
+
+    //group generated by the selected operations, as a product translations x point group x spin flip
+    //the point group contains the inversion on the chain, and the 8 reflections and rotations of the square
+    void BuildGroup(std::string group){
+        bool translations=false;
+        bool reflections=false;
+        bool spinflip=false;
+        for(const auto & c : group){
+            if(c=='t'){
+                translations=true;
+            }
+            else if(c=='r'){
+                reflections=true;
+            }
+            else if(c=='z'){
+                spinflip=true;
+            }
+            else{
+                std::cerr<<"# Error : Unknown symmetry operation "<<c<<" (valid ones are t, r and z)"<<std::endl;
+                std::abort();
+            }
+        }
+
+        const int ntransl=translations?nv_:1;
+        const int npoint=reflections?((dim_==1)?2:8):1;
+        const int nflip=spinflip?2:1;
+
+        ng_=ntransl*npoint*nflip;
+        perm_.resize(ng_*nv_);
+        inv_.resize(ng_*nv_);
+        zflip_.resize(ng_);
+
+        int g=0;
+        for(int f=0;f<nflip;f++){
+            for(int r=0;r<npoint;r++){
+                for(int t=0;t<ntransl;t++){
+                    for(int i=0;i<nv_;i++){
+                        const int j=Translate(PointOperation(i,r),t);
+                        perm_[g*nv_+i]=j;
+                        inv_[g*nv_+j]=i;
+                    }
+                    zflip_[g]=(f==0)?1.:-1.;
+                    g++;
+                }
+            }
+        }
+
+        logimagep_.resize(ng_);
+
+        std::cout<<"# Symmetry-projected NQS with "<<ng_<<" symmetry operations on a "<<dim_<<"d lattice"<<std::endl;
+    }
+
+    //the kernels on the images are evaluated in real arithmetic (T=double) for real networks
+    inline const double * WeightRows(double)const{
+        return &Wre_[0];
+    }
+    inline const std::complex<double> * WeightRows(std::complex<double>)const{
+        return &W_[0];
+    }
+    inline double * Tables(double){
+        return &Ltre_[0];
+    }
+    inline std::complex<double> * Tables(std::complex<double>){
+        return &Lt_[0];
+    }
+    inline const double * Tables(double)const{
+        return &Ltre_[0];
+    }
+    inline const std::complex<double> * Tables(std::complex<double>)const{
+        return &Lt_[0];
+    }
+
+    template<class T> void InitImage(int g,const std::vector<int> & state){
+        const int * p=&perm_[g*nv_];
+        const T * w=WeightRows(T());
+        T * ltg=Tables(T())+g*nh_;
+
+        std::complex<double> vbias=0.;
+        for(int h=0;h<nh_;h++){
+            ltg[h]=Value(b_[h],T());
+        }
+        for(int i=0;i<nv_;i++){
+            const double si=zflip_[g]*double(state[p[i]]);
+            vbias+=a_[i]*si;
+            const T * wi=w+i*nh_;
+            for(int h=0;h<nh_;h++){
+                ltg[h]+=wi[h]*si;
+            }
+        }
+        vbias_[g]=vbias;
+        ComputeLogImage<T>(g);
+    }
+
+    template<class T> void UpdateImage(int g,const std::vector<int> & state,const std::vector<int> & flips){
+        const int * pinv=&inv_[g*nv_];
+        const T * w=WeightRows(T());
+        T * ltg=Tables(T())+g*nh_;
+
+        for(const auto & flip : flips){
+            const int i=pinv[flip];
+            const double sf=2.*zflip_[g]*double(state[flip]);
+            const T * wi=w+i*nh_;
+            vbias_[g]-=sf*a_[i];
+            for(int h=0;h<nh_;h++){
+                ltg[h]-=sf*wi[h];
+            }
+        }
+        ComputeLogImage<T>(g);
+    }
+
+    //log-amplitude of image g of the flipped state
+    template<class T> std::complex<double> LogImageP(int g,const std::vector<int> & state,const std::vector<int> & flips)const{
+        const int * pinv=&inv_[g*nv_];
+        const T * w=WeightRows(T());
+        const T * ltg=Tables(T())+g*nh_;
+        const int nflips=flips.size();
+
+        std::complex<double> logp=vbias_[g];
+        rows_.resize(nflips);
+        coeffs_.resize(nflips);
+        for(int k=0;k<nflips;k++){
+            const int i=pinv[flips[k]];
+            coeffs_[k]=-2.*zflip_[g]*double(state[flips[k]]);
+            rows_[k]=i*nh_;
+            logp+=coeffs_[k]*a_[i];
+        }
+
+        T lncoshsum=0.;
+        for(int h=0;h<nh_;h++){
+            T thetahp=ltg[h];
+            for(int k=0;k<nflips;k++){
+                thetahp+=coeffs_[k]*w[rows_[k]+h];
+            }
+            lncoshsum+=Nqs::lncosh(thetahp);
+        }
+        return logp+lncoshsum;
+    }
+
+    //lncosh of the thetas of image g and its visible bias term
+    template<class T> inline void ComputeLogImage(int g){
+        const T * ltg=Tables(T())+g*nh_;
+        T lncoshsum=0.;
+        for(int h=0;h<nh_;h++){
+            lncoshsum+=Nqs::lncosh(ltg[h]);
+        }
+        logimage_[g]=vbias_[g]+lncoshsum;
+    }
+
+    static inline double Value(std::complex<double> x,double){
+        return x.real();
+    }
+    static inline std::complex<double> Value(std::complex<double> x,std::complex<double>){
+        return x;
+    }
+
+    //log(sum_g exp(logs[g])), shifting by the largest real part
+    static std::complex<double> LogSum(const std::vector<std::complex<double> > & logs){
+        double maxre=logs[0].real();
+        for(const auto & l : logs){
+            maxre=std::max(maxre,l.real());
+        }
+        std::complex<double> sum=0.;
+        for(const auto & l : logs){
+            sum+=std::exp(l-maxre);
+        }
+        return maxre+std::log(sum);
+    }
+
+    //site obtained translating site i by g
+    inline int Translate(int i,int g)const{
+        if(dim_==1){
+            return (i+g)%nv_;
+        }
+        const int x=(i%l_+g%l_)%l_;
+        const int y=(i/l_+g/l_)%l_;
+        return x+l_*y;
+    }
+
+    //site obtained from site i with the point operation r
+    //on the square lattice bit 0 reflects x, bit 1 reflects y, and bit 2 exchanges x and y
+    inline int PointOperation(int i,int r)const{
+        if(dim_==1){
+            return (r==0)?i:(nv_-i)%nv_;
+        }
+        int x=i%l_;
+        int y=i/l_;
+        if(r&1){
+            x=(l_-x)%l_;
+        }
+        if(r&2){
+            y=(l_-y)%l_;
+        }
+        if(r&4){
+            std::swap(x,y);
+        }
+        return x+l_*y;
+    }
+
+};
@@ -0,0 +1,337 @@
+//
+//  nqssymm.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <complex>
+#include <algorithm>
+#include "nqs_paper.h"
+
+//Translation-symmetric neural-network quantum state
+//on a periodic chain (dim=1) or on a periodic square lattice (dim=2)
+//hidden units come in alpha families (filters), each family containing one unit per translation g:
+//theta_{f,g}(state) = b_f + sum_i W_f(i)*state(i+g)
+//only alpha*N weights, alpha hidden biases and one visible bias are stored
+class NqsSymm{
+
+    //filters, W_[f*nv_+i] is the weight of filter f on site i
+    std::vector<std::complex<double> > W_;
+
+    //Fourier transform of the filters, sum_i W_f(i) exp(+i k.i)
+    std::vector<std::complex<double> > Wk_;
+
+    //visible bias (the same on all sites)
+    std::complex<double> a_;
+
+    //hidden bias of each filter
+    std::vector<std::complex<double> > b_;
+
+    //hidden unit density
+    int alpha_;
+
+    //number of visible units
+    int nv_;
+
+    //linear size and dimension of the lattice
+    int l_;
+    const int dim_;
+
+    //look-up tables, Lt_[f*nv_+g]=theta_{f,g}
+    std::vector<std::complex<double> > Lt_;
+
+    //Fourier transforms used to initialize the look-up tables
+    Fft * fft_;
+    std::vector<std::complex<double> > statek_;
+    std::vector<std::complex<double> > thetak_;
+
+    //for each flipped site j, the filter index j-g for all translations g
+    mutable std::vector<std::vector<int> > shifts_;
+
+public:
+
+    //imports the network from a file in the same format used by Nqs
+    NqsSymm(std::string filename,int dim):dim_(dim),fft_(nullptr){
+        LoadParameters(filename);
+    }
+
+    NqsSymm(const NqsSymm & other)=delete;
+
+    ~NqsSymm(){
+        delete fft_;
+    }
+
+    //computes the logarithm of the wave-function
+    std::complex<double> LogVal(const std::vector<int> & state)const{
+        std::complex<double> rbm(0.,0.);
+
+        for(int v=0;v<nv_;v++){
+            rbm+=a_*double(state[v]);
+        }
+
+        for(int f=0;f<alpha_;f++){
+            for(int g=0;g<nv_;g++){
+                std::complex<double> thetah=b_[f];
+                for(int i=0;i<nv_;i++){
+                    thetah+=W_[f*nv_+i]*double(state[Translate(i,g)]);
+                }
+                rbm+=Nqs::lncosh(thetah);
+            }
+        }
+
+        return rbm;
+    }
+
+    //computes the logarithm of Psi(state')/Psi(state)
+    //where state' is obtained from state flipping the sites in "flips"
+    //all the translated images of a flip are obtained by shifting the filter index
+    inline std::complex<double> LogPoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        if(flips.size()==0){
+            return 0.;
+        }
+
+        const int nflips=flips.size();
+
+        std::complex<double> logpop(0.,0.);
+
+        for(int k=0;k<nflips;k++){
+            logpop-=a_*2.*double(state[flips[k]]);
+            ComputeShifts(flips[k],k);
+        }
+
+        for(int f=0;f<alpha_;f++){
+            const std::complex<double> * wf=&W_[f*nv_];
+            const std::complex<double> * ltf=&Lt_[f*nv_];
+
+            for(int g=0;g<nv_;g++){
+                const std::complex<double> thetah=ltf[g];
+                std::complex<double> thetahp=thetah;
+
+                for(int k=0;k<nflips;k++){
+                    thetahp-=2.*double(state[flips[k]])*wf[shifts_[k][g]];
+                }
+                logpop+=(Nqs::lncosh(thetahp)-Nqs::lncosh(thetah));
+            }
+        }
+
+        return logpop;
+    }
+
+    //computes the logarithms of Psi(state'_k)/Psi(state'') for several candidates k
+    //where state'' is obtained flipping "base" on state, and state'_k flipping "cands[k]" on state''
+    void LogPoPMulti(const std::vector<int> & state,const std::vector<int> & base,
+                     const std::vector<std::vector<int> > & cands,std::vector<std::complex<double> > & logpops)const{
+        const std::complex<double> logbase=LogPoP(state,base);
+
+        std::vector<int> flips;
+        logpops.resize(cands.size());
+        for(int k=0;k<int(cands.size());k++){
+            //flipping a site twice leaves it unchanged
+            flips=base;
+            for(const auto & flip : cands[k]){
+                auto it=std::find(flips.begin(),flips.end(),flip);
+                if(it==flips.end()){
+                    flips.push_back(flip);
+                }
+                else{
+                    flips.erase(it);
+                }
+            }
+            logpops[k]=LogPoP(state,flips)-logbase;
+        }
+    }
+
+    inline std::complex<double> PoP(const std::vector<int> & state,const std::vector<int> & flips)const{
+        return std::exp(LogPoP(state,flips));
+    }
+    
+    //|Psi(state')/Psi(state)|^2, used in the Metropolis test (always computed exactly)
+    inline double AcceptRatio(const std::vector<int> & state,const std::vector<int> & flips)const{
+        return std::norm(PoP(state,flips));
+    }
+
+    //initialization of the look-up tables
+    //the correlation of each filter with the state is computed in Fourier space
+    //in O(alpha*N*log(N)) operations
+    void InitLt(const std::vector<int> & state){
+        Lt_.resize(alpha_*nv_);
+
+        for(int i=0;i<nv_;i++){
+            statek_[i]=double(state[i]);
+        }
+        fft_->Transform(statek_);
+
+        for(int f=0;f<alpha_;f++){
+            for(int k=0;k<nv_;k++){
+                thetak_[k]=Wk_[f*nv_+k]*statek_[k];
+            }
+            fft_->Transform(thetak_,true);
+
+            for(int g=0;g<nv_;g++){
+                Lt_[f*nv_+g]=b_[f]+thetak_[g]/double(nv_);
+            }
+        }
+    }
+
+    //updates the look-up tables after spin flips
+    void UpdateLt(const std::vector<int> & state,const std::vector<int> & flips){
+        if(flips.size()==0){
+            return;
+        }
+
+        const int nflips=flips.size();
+
+        for(int k=0;k<nflips;k++){
+            ComputeShifts(flips[k],k);
+        }
+
+        for(int f=0;f<alpha_;f++){
+            const std::complex<double> * wf=&W_[f*nv_];
+            std::complex<double> * ltf=&Lt_[f*nv_];
+
+            for(int k=0;k<nflips;k++){
+                const double sf=2.*double(state[flips[k]]);
+                const std::vector<int> & shift=shifts_[k];
+                for(int g=0;g<nv_;g++){
+                    ltf[g]-=sf*wf[shift[g]];
+                }
+            }
+        }
+    }
+
+    //loads a network stored in the dense format of Nqs
+    //hidden unit f*N+g is interpreted as the translation by g of filter f
+    //the filters are obtained by averaging over translations, which is exact for a symmetric network
+    void LoadParameters(std::string filename){
+        Nqs dense(filename);
+
+        nv_=dense.Nspins();
+        const int nh=dense.Nhidden();
+
+        if(dim_==1){
+            l_=nv_;
+        }
+        else{
+            l_=std::sqrt(double(nv_));
+            if(l_*l_!=nv_){
+                std::cerr<<"# Error , the number of spins is not compabitle with a square lattice "<<std::endl;
+                std::abort();
+            }
+        }
+
+        if(nh%nv_!=0){
+            std::cerr<<"# Error : the number of hidden units must be a multiple of the number of spins for a symmetric network"<<std::endl;
+            std::abort();
+        }
+        alpha_=nh/nv_;
+
+        const auto & W=dense.Weights();
+        const auto & a=dense.VisibleBias();
+        const auto & b=dense.HiddenBias();
+
+        a_=0.;
+        for(int i=0;i<nv_;i++){
+            a_+=a[i]/double(nv_);
+        }
+
+        W_.assign(alpha_*nv_,0.);
+        b_.assign(alpha_,0.);
+
+        for(int f=0;f<alpha_;f++){
+            for(int g=0;g<nv_;g++){
+                b_[f]+=b[f*nv_+g]/double(nv_);
+                for(int i=0;i<nv_;i++){
+                    W_[f*nv_+i]+=W[Translate(i,g)][f*nv_+g]/double(nv_);
+                }
+            }
+        }
+
+        //deviation of the stored network from the symmetric one
+        double maxdev=0;
+        for(int f=0;f<alpha_;f++){
+            for(int g=0;g<nv_;g++){
+                maxdev=std::max(maxdev,std::abs(b[f*nv_+g]-b_[f]));
+                for(int i=0;i<nv_;i++){
+                    maxdev=std::max(maxdev,std::abs(W[Translate(i,g)][f*nv_+g]-W_[f*nv_+i]));
+                }
+            }
+        }
+        for(int i=0;i<nv_;i++){
+            maxdev=std::max(maxdev,std::abs(a[i]-a_));
+        }
+
+        delete fft_;
+        fft_=new Fft(l_,dim_);
+        statek_.resize(nv_);
+        thetak_.resize(nv_);
+
+        Wk_.resize(alpha_*nv_);
+        for(int f=0;f<alpha_;f++){
+            std::vector<std::complex<double> > wf(W_.begin()+f*nv_,W_.begin()+(f+1)*nv_);
+            fft_->Transform(wf,true);
+            std::copy(wf.begin(),wf.end(),Wk_.begin()+f*nv_);
+        }
+
+        shifts_.resize(2,std::vector<int>(nv_));
+
+        std::cout<<"# Symmetric NQS with alpha = "<<alpha_<<" on a "<<dim_<<"d lattice"<<std::endl;
+        std::cout<<"# Stored weights = "<<alpha_*nv_<<" (dense network has "<<nv_*nh<<")"<<std::endl;
+        if(maxdev>1.0e-8){
+            std::cout<<"# Warning : the stored network is not translation symmetric, ";
+            std::cout<<"it has been projected (max deviation "<<maxdev<<")"<<std::endl;
+        }
+    }
+
+    //total number of spins
+    inline int Nspins()const{
+        return nv_;
+    }
+
+    inline int Nhidden()const{
+        return alpha_*nv_;
+    }
+
+private:
+
+    //site obtained translating site i by g
+    inline int Translate(int i,int g)const{
+        if(dim_==1){
+            return (i+g)%nv_;
+        }
+        const int x=(i%l_+g%l_)%l_;
+        const int y=(i/l_+g/l_)%l_;
+        return x+l_*y;
+    }
+
+    //filter index j-g of site j, for all translations g, stored in shifts_[k]
+    inline void ComputeShifts(int j,int k)const{
+        if(int(shifts_.size())<=k){
+            shifts_.resize(k+1,std::vector<int>(nv_));
+        }
+        std::vector<int> & shift=shifts_[k];
+
+        if(dim_==1){
+            for(int g=0;g<=j;g++){
+                shift[g]=j-g;
+            }
+            for(int g=j+1;g<nv_;g++){
+                shift[g]=j-g+nv_;
+            }
+        }
+        else{
+            const int jx=j%l_;
+            const int jy=j/l_;
+            for(int gy=0;gy<l_;gy++){
+                const int y=(jy>=gy)?(jy-gy):(jy-gy+l_);
+                for(int gx=0;gx<l_;gx++){
+                    const int x=(jx>=gx)?(jx-gx):(jx-gx+l_);
+                    shift[gx+l_*gy]=x+l_*y;
+                }
+            }
+        }
+    }
+
+};
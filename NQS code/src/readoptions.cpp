@@ -9,6 +9,8 @@
 #include <map>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <algorithm>
 #include "nqs_paper.h"
 
 //Various utilities to read the command line options
@@ -51,10 +53,10 @@ std::string FindCoupling(std::string strarg){   //找不同模型对应的一个
     return "error";
 }
 
-void PrintHeader(){   //打印介绍信息
-    std::cout<<std::endl;
-    std::cout<<"\t|   Neural-network quantum states sampler   |"<<std::endl;
-    std::cout<<"\t| written by Giuseppe Carleo, December 2016 |"<<std::endl<<std::endl;
+void PrintHeader(std::ostream & out=std::cout){   //打印介绍信息
+    out<<std::endl;
+    out<<"\t|   Neural-network quantum states sampler   |"<<std::endl;
+    out<<"\t| written by Giuseppe Carleo, December 2016 |"<<std::endl<<std::endl;
 }
 
 void PrintInfoMessage(){   //打印介绍信息
@@ -78,11 +80,146 @@ void PrintInfoMessage(){   //打印介绍信息
     std::cout<<"--filestates=... "<<std::endl;
     std::cout<<"\tname of the file to print sampled configurations"<<std::endl;
     std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--thermfactor=... "<<std::endl;
+    std::cout<<"\tfraction of nsweeps discarded for thermalization"<<std::endl;
+    std::cout<<"\t\"auto\" detects the equilibration from the local energy trace"<<std::endl;
+    std::cout<<"\t(default value is auto)"<<std::endl<<std::endl;
+    
+    std::cout<<"--symmetric "<<std::endl;
+    std::cout<<"\tuse a translation-symmetric network, importing its filters from the given file"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--projected=... "<<std::endl;
+    std::cout<<"\tproject the network on the symmetric sector, summing its amplitudes over a group of symmetry operations"<<std::endl;
+    std::cout<<"\tthe group is given by the letters t (translations), r (reflections) and z (global spin flip), e.g. trz"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--graph=... "<<std::endl;
+    std::cout<<"\tname of a file with the bonds and couplings of an XXZ/transverse-field model"<<std::endl;
+    std::cout<<"\t(by default the model is inferred from the file name)"<<std::endl<<std::endl;
+    
+    std::cout<<"--mtm=... "<<std::endl;
+    std::cout<<"\tnumber of candidates of multiple-try Metropolis moves"<<std::endl;
+    std::cout<<"\t(default value is 1, i.e. standard Metropolis moves)"<<std::endl<<std::endl;
+    
+    std::cout<<"--hiddenthreads=... "<<std::endl;
+    std::cout<<"\tnumber of threads among which the hidden units of the network are distributed"<<std::endl;
+    std::cout<<"\t(by default the network is evaluated by a single thread)"<<std::endl<<std::endl;
+    
+    std::cout<<"--localexchange "<<std::endl;
+    std::cout<<"\tpropose only exchanges of antiparallel nearest neighbours (Heisenberg2d and graph models)"<<std::endl;
+    std::cout<<"\t(by default any pair of antiparallel spins can be exchanged)"<<std::endl<<std::endl;
+    
+    std::cout<<"--tvmc=... "<<std::endl;
+    std::cout<<"\tfinal time of a t-VMC evolution of the given network after a quench"<<std::endl;
+    std::cout<<"\tnsweeps is then the number of samples used at each time step"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--quench=... "<<std::endl;
+    std::cout<<"\tcoupling (hfield or jz) of the hamiltonian driving the t-VMC evolution"<<std::endl;
+    std::cout<<"\t(default value is the coupling of the given file)"<<std::endl<<std::endl;
+    
+    std::cout<<"--dtsave=... "<<std::endl;
+    std::cout<<"\ttime interval between the snapshots of the network written during the t-VMC evolution"<<std::endl;
+    std::cout<<"\t(default value is 0.1)"<<std::endl<<std::endl;
+    
+    std::cout<<"--nchains=... "<<std::endl;
+    std::cout<<"\tnumber of Markov chains sampled in parallel during the t-VMC evolution, per network with --fidelity, or pairs of replicas with --renyi"<<std::endl;
+    std::cout<<"\t(default value is the number of cores)"<<std::endl<<std::endl;
+    
+    std::cout<<"--regression=... "<<std::endl;
+    std::cout<<"\tname of a reference file: all the listed wave-functions are sampled with the given sweeps and seeds,"<<std::endl;
+    std::cout<<"\tand energies and throughput (relative to a calibration kernel) are checked against the stored values (see Ground/reference.txt)"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--updatereference "<<std::endl;
+    std::cout<<"\twith --regression, rewrites the reference file with the results of this run"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--accuracy=... "<<std::endl;
+    std::cout<<"\taccuracy of the acceptance ratios: exact, fast (errors ~1e-8) or coarse (errors ~1e-4)"<<std::endl;
+    std::cout<<"\tmeasured quantities are always computed exactly"<<std::endl;
+    std::cout<<"\t(default value is exact)"<<std::endl<<std::endl;
+    
+    std::cout<<"--validateaccuracy "<<std::endl;
+    std::cout<<"\treports the errors and the energy bias introduced by each accuracy tier"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--productratios=... "<<std::endl;
+    std::cout<<"\tevaluates the wave-function ratios as products of cosh(theta')/cosh(theta) from cached tables"<<std::endl;
+    std::cout<<"\tthe given number N>0 compares one ratio every N with the logarithmic evaluation (0 disables the checks)"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--reweight=... "<<std::endl;
+    std::cout<<"\tcomma-separated list of wave-function files (e.g. neighbouring time slices in Unitary/)"<<std::endl;
+    std::cout<<"\twhose energies are estimated reweighting the configurations sampled from --filename"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--minessfraction=... "<<std::endl;
+    std::cout<<"\twith --reweight, files whose effective sample size is below this fraction of nsweeps are sampled again"<<std::endl;
+    std::cout<<"\t(default value is 0.1)"<<std::endl<<std::endl;
+    
+    std::cout<<"--sparsetol=... "<<std::endl;
+    std::cout<<"\tweights with modulus below this value are neglected by the specialized kernels"<<std::endl;
+    std::cout<<"\t(selected for real or sparse networks, and checked against the dense ones), a negative value disables them"<<std::endl;
+    std::cout<<"\t(default value is 0, only vanishing weights are neglected)"<<std::endl<<std::endl;
+    
+    std::cout<<"--serve=... "<<std::endl;
+    std::cout<<"\truns an amplitude server on the given Unix domain socket (- for stdin/stdout), see src/server.cpp for the protocol"<<std::endl;
+    std::cout<<"\tthe network given with --filename is preloaded with the name default"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--servethreads=... "<<std::endl;
+    std::cout<<"\tnumber of threads evaluating the requests of the amplitude server"<<std::endl;
+    std::cout<<"\t(default value is the number of cores)"<<std::endl<<std::endl;
+    
+    std::cout<<"--logvals=... "<<std::endl;
+    std::cout<<"\tfile of configurations (as written by --filestates, or nv signed bytes per configuration if named *.bin)"<<std::endl;
+    std::cout<<"\ton which log(Psi) is evaluated in blocks, the results are written to FILE.logpsi"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--threads=... "<<std::endl;
+    std::cout<<"\tnumber of threads evaluating the blocks of --logvals, running the chains of --fidelity and --renyi,"<<std::endl;
+    std::cout<<"\tor running the blocks of --lockstep"<<std::endl;
+    std::cout<<"\t(default value is the number of cores)"<<std::endl<<std::endl;
+    
+    std::cout<<"--fidelity=... "<<std::endl;
+    std::cout<<"\tcomma-separated list of wave-function files whose fidelity with the network given by --filename is estimated"<<std::endl;
+    std::cout<<"\tnsweeps samples of each network are divided among nchains chains"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--renyi "<<std::endl;
+    std::cout<<"\tsecond Renyi entropy of the blocks [0,l) for all the cuts l, from the swap of two replicas"<<std::endl;
+    std::cout<<"\tnsweeps samples are divided among nchains pairs of replicas"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--correlations "<<std::endl;
+    std::cout<<"\tstructure factor S(q) for all the momenta and correlation functions Czz(r) for all the distances"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--offdiagonal "<<std::endl;
+    std::cout<<"\twith --correlations, measures also the off-diagonal correlations C+-(r)"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--recycle "<<std::endl;
+    std::cout<<"\twith --correlations, measures Czz(r) and S(q) also with the waste-recycling estimator, which uses the rejected proposals"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
+    
+    std::cout<<"--lockstep=... "<<std::endl;
+    std::cout<<"\tnumber of Markov chains advanced in lockstep, sharing the loads of the weights of the flipped spins"<<std::endl;
+    std::cout<<"\tthreads blocks of chains run in parallel, each chain giving nsweeps samples"<<std::endl;
+    std::cout<<"\t(by default it is not set)"<<std::endl<<std::endl;
 }
 
 std::map<std::string,std::string> ReadOptions(int argc,char *argv[]){  //ReadOptions 函数的定义 map模板类-红黑树
     
-    PrintHeader();
+    //an amplitude server on stdin/stdout writes only its responses on stdout
+    bool stdioserver=false;
+    for(int i=1;i<argc;i++){
+        stdioserver=stdioserver || (std::string(argv[i])=="--serve=-");
+    }
+    PrintHeader(stdioserver?std::cerr:std::cout);
     
     std::map<std::string,std::string> options;
     
@@ -101,13 +238,42 @@ std::map<std::string,std::string> ReadOptions(int argc,char *argv[]){  //ReadOpt
             {"nsweeps",  required_argument, 0, 'b'},
             {"seed",    required_argument, 0, 'c'},
             {"filestates",    required_argument, 0, 'd'},
+            {"thermfactor",    required_argument, 0, 'e'},
+            {"symmetric",    no_argument, 0, 'f'},
+            {"graph",    required_argument, 0, 'g'},
+            {"mtm",    required_argument, 0, 'h'},
+            {"hiddenthreads",    required_argument, 0, 'i'},
+            {"localexchange",    no_argument, 0, 'j'},
+            {"tvmc",    required_argument, 0, 'k'},
+            {"quench",    required_argument, 0, 'l'},
+            {"dtsave",    required_argument, 0, 'm'},
+            {"nchains",    required_argument, 0, 'n'},
+            {"regression",    required_argument, 0, 'o'},
+            {"updatereference",    no_argument, 0, 'p'},
+            {"accuracy",    required_argument, 0, 'q'},
+            {"validateaccuracy",    no_argument, 0, 'r'},
+            {"productratios",    required_argument, 0, 's'},
+            {"reweight",    required_argument, 0, 't'},
+            {"minessfraction",    required_argument, 0, 'u'},
+            {"sparsetol",    required_argument, 0, 'v'},
+            {"serve",    required_argument, 0, 'w'},
+            {"servethreads",    required_argument, 0, 'x'},
+            {"logvals",    required_argument, 0, 'y'},
+            {"threads",    required_argument, 0, 'z'},
+            {"fidelity",    required_argument, 0, 'A'},
+            {"renyi",    no_argument, 0, 'B'},
+            {"correlations",    no_argument, 0, 'C'},
+            {"offdiagonal",    no_argument, 0, 'D'},
+            {"recycle",    no_argument, 0, 'G'},
+            {"projected",    required_argument, 0, 'E'},
+            {"lockstep",    required_argument, 0, 'F'},
             {0, 0, 0, 0}
         };
         
         /* getopt_long stores the option index here. */
         int option_index = 0;
         
-        int c = getopt_long (argc, argv, "a:b:c:d:",
+        int c = getopt_long (argc, argv, "a:b:c:d:e:fg:h:i:jk:l:m:n:o:pq:rs:t:u:v:w:x:y:z:A:BCDE:F:G",
                              long_options, &option_index);
         
         /* Detect the end of the options. */
@@ -132,6 +298,122 @@ std::map<std::string,std::string> ReadOptions(int argc,char *argv[]){  //ReadOpt
                 options["filestates"]=optarg;
                 break;
                 
+            case 'e':
+                options["thermfactor"]=optarg;
+                break;
+                
+            case 'f':
+                options["symmetric"]="1";
+                break;
+                
+            case 'g':
+                options["graph"]=optarg;
+                break;
+                
+            case 'h':
+                options["mtm"]=optarg;
+                break;
+                
+            case 'i':
+                options["hiddenthreads"]=optarg;
+                break;
+                
+            case 'j':
+                options["localexchange"]="1";
+                break;
+                
+            case 'k':
+                options["tvmc"]=optarg;
+                break;
+                
+            case 'l':
+                options["quench"]=optarg;
+                break;
+                
+            case 'm':
+                options["dtsave"]=optarg;
+                break;
+                
+            case 'n':
+                options["nchains"]=optarg;
+                break;
+                
+            case 'o':
+                options["regression"]=optarg;
+                break;
+                
+            case 'p':
+                options["updatereference"]="1";
+                break;
+                
+            case 'q':
+                options["accuracy"]=optarg;
+                break;
+                
+            case 'r':
+                options["validateaccuracy"]="1";
+                break;
+                
+            case 's':
+                options["productratios"]=optarg;
+                break;
+                
+            case 't':
+                options["reweight"]=optarg;
+                break;
+                
+            case 'u':
+                options["minessfraction"]=optarg;
+                break;
+                
+            case 'v':
+                options["sparsetol"]=optarg;
+                break;
+                
+            case 'w':
+                options["serve"]=optarg;
+                break;
+                
+            case 'x':
+                options["servethreads"]=optarg;
+                break;
+                
+            case 'y':
+                options["logvals"]=optarg;
+                break;
+                
+            case 'z':
+                options["threads"]=optarg;
+                break;
+                
+            case 'A':
+                options["fidelity"]=optarg;
+                break;
+                
+            case 'B':
+                options["renyi"]="1";
+                break;
+                
+            case 'C':
+                options["correlations"]="1";
+                break;
+                
+            case 'D':
+                options["offdiagonal"]="1";
+                break;
+                
+            case 'E':
+                options["projected"]=optarg;
+                break;
+                
+            case 'F':
+                options["lockstep"]=optarg;
+                break;
+                
+            case 'G':
+                options["recycle"]="1";
+                break;
+                
             case '?':
                 PrintInfoMessage();
                 break;
@@ -141,6 +423,19 @@ std::map<std::string,std::string> ReadOptions(int argc,char *argv[]){  //ReadOpt
         }
     }
     
+    //the files to be sampled are given in the reference file
+    if(options.count("regression")){
+        return options;
+    }
+    
+    //the networks are loaded on request
+    if(options.count("serve")){
+        if(options.count("servethreads")==0){
+            options["servethreads"]=std::to_string(std::max(1u,std::thread::hardware_concurrency()));
+        }
+        return options;
+    }
+    
     if(options.count("filename")==0){     //count函数是STL里面的 统计容器中等于value元素的个数
         std::cerr<<"# Error: Option filename must be specified with the option --filename=FILENAME"<<std::endl;
         std::abort();
@@ -154,6 +449,40 @@ std::map<std::string,std::string> ReadOptions(int argc,char *argv[]){  //ReadOpt
         options["seed"]="-1";
     }
     
+    if(options.count("thermfactor")==0 || options["thermfactor"]=="auto"){
+        options["thermfactor"]="-1";
+    }
+    else if(std::stod(options["thermfactor"])<0 || std::stod(options["thermfactor"])>1){
+        std::cerr<<"# Error : Option thermfactor must be a real number between 0 and 1, or auto"<<std::endl;
+        std::abort();
+    }
+    
+    if(options.count("dtsave")==0){
+        options["dtsave"]="0.1";
+    }
+    
+    if(options.count("nchains")==0){
+        options["nchains"]=std::to_string(std::max(1u,std::thread::hardware_concurrency()));
+    }
+    
+    if(options.count("minessfraction")==0){
+        options["minessfraction"]="0.1";
+    }
+    
+    if(options.count("threads")==0){
+        options["threads"]=std::to_string(std::max(1u,std::thread::hardware_concurrency()));
+    }
+    
+    //no hamiltonian is needed to evaluate the wave-function
+    if(options.count("logvals")){
+        return options;
+    }
+    
+    if(options.count("graph")){
+        options["model"]="Graph";
+        return options;
+    }
+    
     options["model"]=FindModel(options["filename"]);  //将读取到的模型放到options中
     
     if(options["model"]=="Ising1d"){
@@ -163,5 +492,9 @@ std::map<std::string,std::string> ReadOptions(int argc,char *argv[]){  //ReadOpt
         options["jz"]=FindCoupling(options["filename"]);
     }
     
+    if(options.count("quench")==0){
+        options["quench"]=FindCoupling(options["filename"]);
+    }
+    
     return options;
 }
@@ -0,0 +1,220 @@
+//
+//  regression.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include "nqs_paper.h"
+
+//Accuracy and throughput regression runs
+//The reference file has one line per wave-function file:
+//filename  nsweeps  seed  energy_per_spin  error  sweeps  measurements
+//lines starting with # are comments
+//Each file is sampled with the given number of sweeps and seed, the energy must agree with the reference
+//(or with the exact energy, for small systems) within the statistical errors,
+//and the throughput is compared with the stored baseline
+//Throughputs are stored relative to the rate of a calibration kernel (sweeps and measurements per kernel pass),
+//so that the baseline does not depend on the host and on the build: each file is timed in a few repetitions,
+//with the kernel measured before and after each of them, and the median of the relative throughputs is taken
+
+struct RegressionEntry{
+    std::string filename;
+    double nsweeps;
+    int seed;
+    double energy;
+    double error;
+    //throughputs, in sweeps and measurements per calibration kernel pass
+    double sweepsps;
+    double measps;
+
+    //exact energy per spin, computed only for small systems
+    bool hasexact;
+    double exact;
+};
+
+//maximum deviation of the energy, in units of the statistical error
+const double kRegressionSigmas=4.;
+
+//smallest error per spin used in the comparisons, binning errors of very short runs can be underestimated
+const double kRegressionMinError=1.0e-5;
+
+//allowed relative loss of throughput with respect to the baseline,
+//above the spread of the relative throughputs between runs on the same host (about 25% on a shared host)
+const double kRegressionSpeedTol=0.3;
+
+//number of timed repetitions of each file
+const int kRegressionRepetitions=5;
+
+//size of the calibration kernel
+const int kCalibrationSpins=40;
+
+//Rate (passes per second) of the calibration kernel: kCalibrationSpins updates of the kCalibrationSpins
+//angles of a network with their lncosh, i.e. the work of a sweep of a 40-spin network with alpha=1
+//the median rate of a few repetitions is taken, to be insensitive to transient loads of the host
+double CalibrationRate(double seconds=0.05,int repetitions=5){
+    const int n=kCalibrationSpins;
+
+    std::vector<std::complex<double> > theta(n);
+    std::vector<std::vector<std::complex<double> > > w(n,std::vector<std::complex<double> >(n));
+    for(int i=0;i<n;i++){
+        theta[i]=std::complex<double>(0.01*i,0.02*i);
+        for(int j=0;j<n;j++){
+            w[i][j]=std::complex<double>(0.01*std::sin(i+2.*j),0.01*std::cos(2.*i+j));
+        }
+    }
+
+    //the result of the kernel is stored, so that the kernel is not optimized away
+    std::vector<double> rates;
+    volatile double sink=0;
+    for(int r=0;r<repetitions;r++){
+        long npasses=0;
+        const auto t0=std::chrono::steady_clock::now();
+        double elapsed=0;
+        while(elapsed<seconds){
+            for(int pass=0;pass<100;pass++){
+                const double sign=(pass%2)?-1.:1.;
+                for(int i=0;i<n;i++){
+                    std::complex<double> logpop=0.;
+                    for(int j=0;j<n;j++){
+                        theta[j]+=sign*w[i][j];
+                        logpop+=Nqs::lncosh(theta[j]);
+                    }
+                    sink=sink+logpop.real();
+                }
+            }
+            npasses+=100;
+            elapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        }
+        rates.push_back(npasses/elapsed);
+    }
+
+    std::sort(rates.begin(),rates.end());
+    return rates[repetitions/2];
+}
+
+std::vector<RegressionEntry> ReadReference(std::string filename){
+    std::ifstream fin(filename.c_str());
+    if(!fin.good()){
+        std::cerr<<"# Error : Cannot open reference file "<<filename<<std::endl;
+        std::abort();
+    }
+
+    std::vector<RegressionEntry> entries;
+    std::string line;
+    while(std::getline(fin,line)){
+        if(line.size()==0 || line[0]=='#'){
+            continue;
+        }
+        std::istringstream sline(line);
+        RegressionEntry entry;
+        if(!(sline>>entry.filename>>entry.nsweeps>>entry.seed)){
+            std::cerr<<"# Error : Invalid line in reference file : "<<line<<std::endl;
+            std::abort();
+        }
+        //a new entry may give only the file name, the number of sweeps and the seed
+        if(!(sline>>entry.energy>>entry.error>>entry.sweepsps>>entry.measps)){
+            entry.energy=entry.error=entry.sweepsps=entry.measps=0;
+        }
+        entry.hasexact=false;
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+void WriteReference(std::string filename,const std::vector<RegressionEntry> & entries){
+    std::ofstream fout(filename.c_str());
+    if(!fout.good()){
+        std::cerr<<"# Error : Cannot open reference file "<<filename<<" for writing"<<std::endl;
+        std::abort();
+    }
+
+    fout<<"# filename  nsweeps  seed  energy_per_spin  error  sweeps  measurements (per calibration kernel pass)"<<std::endl;
+    for(const auto & entry : entries){
+        fout<<entry.filename<<"  "<<long(entry.nsweeps)<<"  "<<entry.seed<<"  ";
+        fout<<std::scientific<<std::setprecision(8)<<entry.energy<<"  ";
+        fout<<std::setprecision(2)<<entry.error<<"  "<<entry.sweepsps<<"  "<<entry.measps<<std::endl;
+        fout<<std::defaultfloat;
+    }
+}
+
+//Samples one wave-function with the settings of the reference, storing the results in "result"
+struct RegressionDriver{
+
+    RegressionEntry & result;
+
+    template<class Wf,class Hamiltonian> void operator()(Wf & wavef,Hamiltonian & hamiltonian){
+        //the repetitions use the same seed, and give the same energy
+        std::vector<double> sweepsps,measps;
+        for(int r=0;r<kRegressionRepetitions;r++){
+            const double calibration=CalibrationRate();
+
+            Sampler<Wf,Hamiltonian> sampler(wavef,hamiltonian,result.seed);
+            sampler.Run(result.nsweeps);
+
+            //rate of the kernel during the run
+            const double rate=std::sqrt(calibration*CalibrationRate());
+
+            result.energy=sampler.EnergyPerSpin();
+            result.error=sampler.EnergyError();
+            sweepsps.push_back(sampler.SweepsPerSecond()/rate);
+            measps.push_back(sampler.MeasurementsPerSecond()/rate);
+        }
+        std::sort(sweepsps.begin(),sweepsps.end());
+        std::sort(measps.begin(),measps.end());
+        result.sweepsps=sweepsps[kRegressionRepetitions/2];
+        result.measps=measps[kRegressionRepetitions/2];
+
+        result.hasexact=(wavef.Nspins()<=kMaxExactSpins);
+        if(result.hasexact){
+            result.exact=ExactEnergy(wavef,hamiltonian);
+        }
+    }
+};
+
+//Compares a result with its reference, printing a summary line
+//returns 0 if the run passes, 1 if the energy is not compatible, 2 if only the throughput is worse
+int CheckRegression(const RegressionEntry & ref,const RegressionEntry & res){
+    bool energyok;
+    double deviation;
+
+    const double error=std::max(res.error,kRegressionMinError);
+    const double referror=std::max(ref.error,kRegressionMinError);
+
+    if(res.hasexact){
+        deviation=std::abs(res.energy-res.exact)/error;
+    }
+    else{
+        deviation=std::abs(res.energy-ref.energy)/std::sqrt(error*error+referror*referror);
+    }
+    energyok=(deviation<=kRegressionSigmas);
+
+    const double sweepratio=res.sweepsps/ref.sweepsps;
+    const double measratio=res.measps/ref.measps;
+    const bool speedok=(sweepratio>=1.-kRegressionSpeedTol && measratio>=1.-kRegressionSpeedTol);
+
+    std::cout<<(energyok?"PASS ":"FAIL ")<<std::setw(32)<<std::left<<ref.filename<<std::right;
+    std::cout<<std::scientific<<std::setprecision(6)<<" E = "<<res.energy<<" +/- "<<std::setprecision(1)<<res.error;
+    if(res.hasexact){
+        std::cout<<" (exact "<<std::setprecision(6)<<res.exact<<")";
+    }
+    else{
+        std::cout<<" (ref "<<std::setprecision(6)<<ref.energy<<")";
+    }
+    std::cout<<std::fixed<<std::setprecision(2)<<"  "<<deviation<<" sigma";
+    std::cout<<"  sweeps/s x"<<sweepratio<<"  meas/s x"<<measratio;
+    std::cout<<(speedok?"":"  SLOWER")<<std::endl;
+    std::cout<<std::defaultfloat;
+
+    if(!energyok){
+        return 1;
+    }
+    return speedok?0:2;
+}
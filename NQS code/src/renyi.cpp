@@ -0,0 +1,144 @@
+//
+//  renyi.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <complex>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include "nqs_paper.h"
+
+//Second Renyi entropy S2(A) = -log Tr(rho_A^2) of the blocks A = [0,l), for all the cuts l=1..N-1
+//Two replicas s1, s2 are sampled independently from |Psi|^2, and Tr(rho_A^2) = <Swap_A> with
+//Swap_A = Psi(s1')Psi(s2')/(Psi(s1)Psi(s2)), where s1' and s2' are obtained exchanging the spins of A between the replicas
+//Exchanging the spins of A amounts to flipping the sites of A where the replicas differ, so for all the cuts
+//the ratios of each replica are obtained from a single LogPoPSequence over the differing sites, in O(N*nh) operations
+//For hamiltonians conserving the magnetization the amplitudes vanish outside the sector of the sampled states,
+//so the exchanges changing the magnetization of the replicas do not contribute
+template<class Hamiltonian> class Renyi{
+
+    Nqs & wf_;
+
+    Hamiltonian & hamiltonian_;
+
+    //number of pairs of replicas, and of threads running them
+    const int npairs_;
+    const int nthreads_;
+
+    const int nspins_;
+    const int nflips_;
+
+    //averages of Swap_A for each pair of replicas and cut, swap_[p][l-1]
+    std::vector<std::vector<StreamingBinning> > swap_;
+
+public:
+
+    Renyi(Nqs & wf,Hamiltonian & hamiltonian,int npairs,int nthreads):
+    wf_(wf),hamiltonian_(hamiltonian),npairs_(npairs),nthreads_(std::max(nthreads,1)),
+    nspins_(wf.Nspins()),nflips_(hamiltonian.MinFlips()){
+        if(npairs_<1){
+            std::cerr<<"# Error : The number of pairs of replicas should be at least 1"<<std::endl;
+            std::abort();
+        }
+    }
+
+    //nsweeps samples divided among the pairs of replicas
+    void Run(int nsweeps,double thermfactor,int seed){
+        const int nperpair=nsweeps/npairs_;
+
+        std::cout<<"# Second Renyi entropy with "<<npairs_<<" pairs of replicas"<<std::endl;
+
+        swap_.assign(npairs_,std::vector<StreamingBinning>(nspins_-1));
+
+        std::atomic<int> next(0);
+        std::vector<std::thread> threads;
+        for(int t=0;t<std::min(nthreads_,npairs_);t++){
+            threads.push_back(std::thread([this,&next,nperpair,thermfactor,seed](){
+                for(int p=next++;p<npairs_;p=next++){
+                    RunPair(p,nperpair,thermfactor,seed);
+                }
+            }));
+        }
+        for(auto & thread : threads){
+            thread.join();
+        }
+
+        std::cout<<"# cut  S2  error  <Swap_A>"<<std::endl;
+        for(int l=1;l<nspins_;l++){
+            std::complex<double> mean=0.;
+            double error=0;
+            for(int p=0;p<npairs_;p++){
+                mean+=swap_[p][l-1].Mean();
+                error+=std::pow(swap_[p][l-1].Error(),2);
+            }
+            mean/=double(npairs_);
+            error=std::sqrt(error)/double(npairs_);
+
+            std::cout<<l<<"  "<<std::fixed<<std::setprecision(6)<<-std::log(mean.real())<<"  "<<error/mean.real();
+            std::cout<<"  "<<std::scientific<<std::setprecision(6)<<mean.real()<<std::endl;
+            std::cout<<std::defaultfloat;
+        }
+    }
+
+private:
+
+    void RunPair(int p,int nsamples,double thermfactor,int seed){
+        Nqs wf1(wf_);
+        Nqs wf2(wf_);
+        Hamiltonian ham1(hamiltonian_);
+        Hamiltonian ham2(hamiltonian_);
+        Sampler<Nqs,Hamiltonian> sampler1(wf1,ham1,seed,2*p);
+        Sampler<Nqs,Hamiltonian> sampler2(wf2,ham2,seed,2*p+1);
+
+        sampler1.Equilibrate(nsamples,thermfactor,nflips_);
+        sampler2.Equilibrate(nsamples,thermfactor,nflips_);
+
+        std::vector<int> differ;
+        std::vector<std::complex<double> > logpop1,logpop2;
+
+        for(int n=0;n<nsamples;n++){
+            sampler1.Sweep(nflips_);
+            sampler2.Sweep(nflips_);
+            const std::vector<int> & s1=sampler1.State();
+            const std::vector<int> & s2=sampler2.State();
+
+            //sites where the replicas differ, in increasing order
+            differ.clear();
+            for(int i=0;i<nspins_;i++){
+                if(s1[i]!=s2[i]){
+                    differ.push_back(i);
+                }
+            }
+
+            wf1.LogPoPSequence(s1,differ,logpop1);
+            wf2.LogPoPSequence(s2,differ,logpop2);
+
+            //m is the number of differing sites in A=[0,l), mag the magnetization of the replica 1 on them
+            int m=0;
+            int mag=0;
+            for(int l=1;l<nspins_;l++){
+                if(m<int(differ.size()) && differ[m]==l-1){
+                    mag+=s1[l-1];
+                    m++;
+                }
+
+                std::complex<double> swap=1.;
+                if(m>0){
+                    if(nflips_==2 && mag!=0){
+                        swap=0.;
+                    }
+                    else{
+                        swap=std::exp(logpop1[m-1]+logpop2[m-1]);
+                    }
+                }
+                swap_[p][l-1].Add(swap);
+            }
+        }
+    }
+
+};
@@ -0,0 +1,175 @@
+//
+//  reweight.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <complex>
+#include <memory>
+#include <cmath>
+#include "nqs_paper.h"
+
+//Correlated sampling of a window of wave-functions (e.g. neighbouring time slices in Unitary/)
+//Configurations are sampled once from |Psi_0|^2, and the energy of each wave-function Psi_k of the window
+//is estimated with the importance weights w_k = |Psi_k/Psi_0|^2 evaluated on the same configurations
+//The effective sample size (sum w)^2/sum w^2 measures the quality of the weights,
+//and when it falls below a fraction of the number of samples the wave-function is sampled again from scratch
+template<class Hamiltonian> class Reweighting{
+
+    //sampled wave-function
+    Nqs & wf_;
+
+    Hamiltonian & hamiltonian_;
+
+    //wave-functions of the window, and their file names
+    std::vector<std::unique_ptr<Nqs> > targets_;
+    std::vector<std::string> names_;
+
+    //minimum effective sample size, as a fraction of the number of samples
+    const double minessfraction_;
+
+    //log of the weights and local energies of each target, for all the samples
+    std::vector<std::vector<double> > logw_;
+    std::vector<std::vector<double> > eloc_;
+
+    std::vector<std::vector<int> > flipsh_;
+    std::vector<std::complex<double> > mel_;
+
+public:
+
+    Reweighting(Nqs & wf,Hamiltonian & hamiltonian,double minessfraction=0.1):
+    wf_(wf),hamiltonian_(hamiltonian),minessfraction_(minessfraction){
+    }
+
+    //adds a wave-function of the window
+    void AddTarget(std::string filename){
+        targets_.push_back(std::unique_ptr<Nqs>(new Nqs(filename)));
+        names_.push_back(filename);
+
+        if(targets_.back()->Nspins()!=wf_.Nspins()){
+            std::cerr<<"# Error : The wave-functions of the window must have the same number of spins"<<std::endl;
+            std::abort();
+        }
+    }
+
+    void Run(int nsweeps,double thermfactor,int seed){
+        const int ntargets=targets_.size();
+        const int nflips=hamiltonian_.MinFlips();
+        const int nspins=wf_.Nspins();
+
+        if(nsweeps<50){
+            std::cerr<<"# Error : Please enter a number of sweeps sufficiently large (>50)"<<std::endl;
+            std::abort();
+        }
+
+        logw_.assign(ntargets,std::vector<double>(nsweeps));
+        eloc_.assign(ntargets,std::vector<double>(nsweeps));
+
+        std::cout<<"# Correlated sampling of "<<ntargets<<" wave-functions"<<std::endl;
+
+        Sampler<Nqs,Hamiltonian> sampler(wf_,hamiltonian_,seed);
+        sampler.Equilibrate(nsweeps,thermfactor,nflips);
+
+        for(int n=0;n<nsweeps;n++){
+            sampler.Sweep(nflips);
+            const std::vector<int> & state=sampler.State();
+            const std::complex<double> logpsi0=wf_.LogVal(state);
+
+            hamiltonian_.FindConn(state,flipsh_,mel_);
+
+            //every network of the window is evaluated on the same configuration
+            for(int k=0;k<ntargets;k++){
+                Nqs & target=*targets_[k];
+                target.InitLt(state);
+
+                logw_[k][n]=2.*(target.LogVal(state)-logpsi0).real();
+
+                std::complex<double> en=0.;
+                for(int i=0;i<int(flipsh_.size());i++){
+                    en+=target.PoP(state,flipsh_[i])*mel_[i];
+                }
+                eloc_[k][n]=en.real();
+            }
+        }
+
+        std::cout<<"# file  ESS  ESS/N  energy per spin  error  method"<<std::endl;
+
+        for(int k=0;k<ntargets;k++){
+            double ess,energy,error;
+            Estimate(k,ess,energy,error);
+
+            std::string method="reweighted";
+            if(ess<minessfraction_*double(nsweeps)){
+                //the weights are degenerate, the wave-function is sampled directly
+                Fresh(k,nsweeps,thermfactor,seed,energy,error);
+                method="fresh";
+            }
+
+            std::cout<<names_[k]<<"  "<<std::fixed<<std::setprecision(1)<<ess<<"  "<<std::setprecision(3)<<ess/double(nsweeps);
+            std::cout<<"  "<<std::scientific<<std::setprecision(6)<<energy/double(nspins);
+            std::cout<<"  "<<std::setprecision(1)<<error/double(nspins)<<"  "<<method<<std::endl;
+            std::cout<<std::defaultfloat;
+        }
+    }
+
+private:
+
+    //reweighted energy of target k, with its error from a binning analysis of the ratio estimator
+    void Estimate(int k,double & ess,double & energy,double & error)const{
+        const std::vector<double> & logw=logw_[k];
+        const std::vector<double> & eloc=eloc_[k];
+        const int nsamp=logw.size();
+
+        double logwmax=logw[0];
+        for(const auto & lw : logw){
+            logwmax=std::max(logwmax,lw);
+        }
+
+        double sumw=0,sumw2=0,sumwe=0;
+        std::vector<double> w(nsamp);
+        for(int n=0;n<nsamp;n++){
+            w[n]=std::exp(logw[n]-logwmax);
+            sumw+=w[n];
+            sumw2+=w[n]*w[n];
+            sumwe+=w[n]*eloc[n];
+        }
+
+        ess=sumw*sumw/sumw2;
+        energy=sumwe/sumw;
+
+        //binning of w*(E-energy), whose average vanishes
+        const int nblocks=50;
+        const int blocksize=nsamp/nblocks;
+        const double wmean=sumw/double(nsamp);
+        double var=0;
+        for(int b=0;b<nblocks;b++){
+            double block=0;
+            for(int n=b*blocksize;n<(b+1)*blocksize;n++){
+                block+=w[n]*(eloc[n]-energy);
+            }
+            block/=double(blocksize)*wmean;
+            var+=block*block;
+        }
+        var/=double(nblocks-1);
+        error=std::sqrt(var/double(nblocks));
+    }
+
+    //energy of target k from an independent sampling
+    void Fresh(int k,int nsweeps,double thermfactor,int seed,double & energy,double & error){
+        std::ostringstream log;
+        std::streambuf * coutbuf=std::cout.rdbuf(log.rdbuf());
+
+        Sampler<Nqs,Hamiltonian> sampler(*targets_[k],hamiltonian_,seed);
+        sampler.Run(nsweeps,thermfactor);
+
+        std::cout.rdbuf(coutbuf);
+
+        energy=sampler.EnergyPerSpin()*double(wf_.Nspins());
+        error=sampler.EnergyError()*double(wf_.Nspins());
+    }
+
+};
@@ -7,13 +7,25 @@
 //
 
 #include <vector>
-#include <random>
 #include <fstream>
 #include <iomanip>
 #include <limits>
 #include <ctime>
+#include <chrono>
 #include "nqs_paper.h"
 
+//Seed to be shared by several generators: a negative seed is replaced by the internal clock value,
+//as done by a single sampler
+inline int ResolveSeed(int seed){
+    return (seed<0)?int(std::time(nullptr)&0x7fffffff):seed;
+}
+
+//Observer of the proposals of the moves that ignores them (see Sampler::Move)
+struct NoProposalObserver{
+    inline void operator()(const std::vector<int> &,const std::vector<int> &,double)const{
+    }
+};
+
 //Simple Monte Carlo sampling of a spin  蒙特卡罗采样
 //Wave-Function
 template<class Wf,class Hamiltonian> class Sampler{
@@ -30,10 +42,10 @@ template<class Wf,class Hamiltonian> class Sampler{
     //current state in the sampling
     std::vector<int> state_;
     
-    //random number generators and distributions  随机数生成器和发布器
-    std::mt19937 gen_;
-    std::uniform_real_distribution<> distu_;
-    std::uniform_int_distribution<> distn_;
+    //random number generator  随机数生成器
+    //counter-based, the stream is identified by the seed and by the index of the chain
+    nqs::Philox gen_;
+    const int chain_;
     
     //sampling statistics     抽样统计
     double accept_;
@@ -41,6 +53,7 @@ template<class Wf,class Hamiltonian> class Sampler{
     
     //container for indices of randomly chosen spins to be flipped
     std::vector<int> flips_;
+    const std::vector<int> noflips_;
     
     //option to write the sampled configuration on a file
     bool writestates_;
@@ -56,13 +69,58 @@ template<class Wf,class Hamiltonian> class Sampler{
     //storage for measured values of the energy   存储能量的测量值
     std::vector<std::complex<double> > energy_;
     
+    //number of candidates proposed at each multiple-try Metropolis step (1 means standard Metropolis)
+    int mtm_;
+    
+    //candidate moves, reference moves and their log amplitude ratios for multiple-try Metropolis
+    std::vector<std::vector<int> > cands_;
+    std::vector<std::vector<int> > refs_;
+    std::vector<std::complex<double> > logcands_;
+    std::vector<std::complex<double> > logrefs_;
+    std::vector<double> wcands_;
+    
+    //sets of up and down spins, used to propose only exchanges of antiparallel spins
+    //setpos_[i] is the position of site i in its set
+    bool spinsets_;
+    std::vector<int> up_;
+    std::vector<int> down_;
+    std::vector<int> setpos_;
+    
+    //bonds along which neighbour exchanges are proposed (if any), bonds touching each site,
+    //and set of antiparallel bonds
+    std::vector<std::vector<int> > bonds_;
+    std::vector<std::vector<int> > sitebonds_;
+    std::vector<int> antibonds_;
+    std::vector<int> antipos_;
+    
+    //ratio of the proposal probabilities of the reverse and of the forward move
+    double hastings_;
+    
+    //whether the last automatic thermalization detected the equilibrium
+    bool thermalized_;
+    
+    //results of the last run: energy per spin with its error,
+    //and time (in seconds) spent in the sweeps and in the measurements
+    double estav_;
+    double esterror_;
+    double sweeptime_;
+    double meastime_;
+    double nsweepsdone_;
+    
 public:
     
-    Sampler(Wf & wf,Hamiltonian & hamiltonian,int seed):
-    wf_(wf),hamiltonian_(hamiltonian),distu_(0,1),nspins_(wf.Nspins()),distn_(0,nspins_-1)
+    //chain is the index of the Markov chain, independent chains with the same seed use independent random streams
+    Sampler(Wf & wf,Hamiltonian & hamiltonian,int seed,int chain=0):
+    wf_(wf),hamiltonian_(hamiltonian),nspins_(wf.Nspins()),chain_(chain)
     {
         
         writestates_=false;
+        mtm_=1;
+        spinsets_=false;
+        hastings_=1;
+        thermalized_=false;
+        estav_=esterror_=0;
+        sweeptime_=meastime_=nsweepsdone_=0;
         Seed(seed);
         ResetAv();
     }
@@ -75,27 +133,51 @@ public:
     
     //Uniform random number in [0,1) uniform函数返回的是0和1之间的随机数
     inline double Uniform(){
-        return distu_(gen_);
+        return gen_.Uniform();
     }
     
     inline void Seed(int seed){
         if(seed<0){
-            gen_.seed(std::time(nullptr));
+            gen_.SeedFromClock(chain_,nqs::Philox::kSampler);
         }
         else{
-            gen_.seed(seed);
+            gen_.Seed(seed,chain_,nqs::Philox::kSampler);
         }
     }
     
     //Random spin flips (max 2 spin flips in this implementation)  这部分并不是很懂
     //if mag0=true, when doing 2 spin flips the total magnetization is kept equal to 0
     //if mag0=true,当进行2次旋转翻转时，总磁化强度保持等于0
+    //if the sets of up and down spins are active, only exchanges of antiparallel spins are proposed
+    //if exchange bonds are set, only exchanges of antiparallel spins along the bonds are proposed
     inline bool RandSpin(std::vector<int> & flips,int nflips,bool mag0=true){
         flips.resize(nflips);
+        hastings_=1;
         
-        flips[0]=distn_(gen_);
+        if(nflips==2 && mag0 && spinsets_){
+            if(bonds_.size()>0){
+                if(antibonds_.size()==0){
+                    return false;
+                }
+                const std::vector<int> & bond=bonds_[antibonds_[gen_.Index(antibonds_.size())]];
+                flips[0]=bond[0];
+                flips[1]=bond[1];
+                
+                //the reverse move is chosen among the antiparallel bonds of the new state
+                hastings_=double(antibonds_.size())/double(int(antibonds_.size())+AntiBondsChange(flips));
+                return true;
+            }
+            if(up_.size()==0 || down_.size()==0){
+                return false;
+            }
+            flips[0]=up_[gen_.Index(up_.size())];
+            flips[1]=down_[gen_.Index(down_.size())];
+            return true;
+        }
+        
+        flips[0]=gen_.Index(nspins_);
         if(nflips==2){
-            flips[1]=distn_(gen_);
+            flips[1]=gen_.Index(nspins_);
             if(!mag0){
                 return flips[1]!=flips[0];
             }
@@ -128,17 +210,17 @@ public:
                     magt+=state_[i];
                 }
                 if(magt>0){
-                    int rs=distn_(gen_);
+                    int rs=gen_.Index(nspins_);
                     while(state_[rs]<0){
-                        rs=distn_(gen_);
+                        rs=gen_.Index(nspins_);
                     }
                     state_[rs]=-1;
                     magt-=1;
                 }
                 else if(magt<0){
-                    int rs=distn_(gen_);
+                    int rs=gen_.Index(nspins_);
                     while(state_[rs]>0){
-                        rs=distn_(gen_);
+                        rs=gen_.Index(nspins_);
                     }
                     state_[rs]=1;
                     magt+=1;
@@ -147,6 +229,97 @@ public:
         }
     }
     
+    //Sets the bonds along which exchange moves are proposed
+    void SetExchangeBonds(const std::vector<std::vector<int> > & bonds){
+        if(mtm_>1){
+            std::cerr<<"# Error : Neighbour exchanges cannot be combined with multiple-try Metropolis moves"<<std::endl;
+            std::abort();
+        }
+        bonds_=bonds;
+        sitebonds_.assign(nspins_,std::vector<int>());
+        for(int b=0;b<int(bonds_.size());b++){
+            sitebonds_[bonds_[b][0]].push_back(b);
+            sitebonds_[bonds_[b][1]].push_back(b);
+        }
+        std::cout<<"# Exchange moves restricted to "<<bonds_.size()<<" bonds"<<std::endl;
+    }
+    
+    //Initializes the sets of up and down spins (and of antiparallel bonds) for the current state
+    void InitSpinSets(bool active){
+        spinsets_=active;
+        up_.clear();
+        down_.clear();
+        setpos_.resize(nspins_);
+        for(int i=0;i<nspins_;i++){
+            std::vector<int> & set=(state_[i]>0)?up_:down_;
+            setpos_[i]=set.size();
+            set.push_back(i);
+        }
+        
+        antibonds_.clear();
+        antipos_.assign(bonds_.size(),-1);
+        for(int b=0;b<int(bonds_.size());b++){
+            if(state_[bonds_[b][0]]!=state_[bonds_[b][1]]){
+                antipos_[b]=antibonds_.size();
+                antibonds_.push_back(b);
+            }
+        }
+    }
+    
+    //Flips the given spins of the current state, keeping the sets of up/down spins
+    //and of antiparallel bonds up to date in O(1) per flip (O(coordination) for the bonds)
+    inline void FlipSpins(const std::vector<int> & flips){
+        for(const auto& flip : flips){
+            if(spinsets_){
+                std::vector<int> & from=(state_[flip]>0)?up_:down_;
+                std::vector<int> & to=(state_[flip]>0)?down_:up_;
+                const int last=from.back();
+                from[setpos_[flip]]=last;
+                setpos_[last]=setpos_[flip];
+                from.pop_back();
+                setpos_[flip]=to.size();
+                to.push_back(flip);
+            }
+            state_[flip]*=-1;
+        }
+        
+        if(spinsets_ && bonds_.size()>0){
+            for(const auto& flip : flips){
+                for(const auto& b : sitebonds_[flip]){
+                    const bool anti=(state_[bonds_[b][0]]!=state_[bonds_[b][1]]);
+                    if(anti && antipos_[b]<0){
+                        antipos_[b]=antibonds_.size();
+                        antibonds_.push_back(b);
+                    }
+                    else if(!anti && antipos_[b]>=0){
+                        const int last=antibonds_.back();
+                        antibonds_[antipos_[b]]=last;
+                        antipos_[last]=antipos_[b];
+                        antibonds_.pop_back();
+                        antipos_[b]=-1;
+                    }
+                }
+            }
+        }
+    }
+    
+    //change in the number of antiparallel bonds if the two given antiparallel spins are exchanged
+    inline int AntiBondsChange(const std::vector<int> & flips)const{
+        int change=0;
+        for(const auto& flip : flips){
+            for(const auto& b : sitebonds_[flip]){
+                const int si=bonds_[b][0];
+                const int sj=bonds_[b][1];
+                //the bond between the two exchanged spins stays antiparallel
+                if((si==flips[0] && sj==flips[1]) || (si==flips[1] && sj==flips[0])){
+                    continue;
+                }
+                change+=(state_[si]==state_[sj])?1:-1;
+            }
+        }
+        return change;
+    }
+    
     void ResetAv(){  //重置Av
         accept_=0;
         nmoves_=0;
@@ -156,13 +329,51 @@ public:
         return accept_/nmoves_;
     }
     
+    //sets the number of candidates of multiple-try Metropolis moves
+    void SetMultipleTry(int ntries){
+        if(ntries<1){
+            std::cerr<<"# Error : The number of multiple-try candidates should be at least 1"<<std::endl;
+            std::abort();
+        }
+        if(ntries>1 && bonds_.size()>0){
+            std::cerr<<"# Error : Neighbour exchanges cannot be combined with multiple-try Metropolis moves"<<std::endl;
+            std::abort();
+        }
+        mtm_=ntries;
+        cands_.resize(mtm_);
+        refs_.resize(mtm_-1);
+        wcands_.resize(mtm_);
+        if(mtm_>1){
+            std::cout<<"# Using multiple-try Metropolis moves with "<<mtm_<<" candidates"<<std::endl;
+        }
+    }
+    
     void Move(int nflips){
+        Move(nflips,NoProposalObserver());
+    }
+    
+    //Move that also passes each proposal to the observer, before the Metropolis-Hastings test:
+    //observer(state,flips,a) with a=min(1,A) the acceptance probability of the proposal,
+    //a proposal that violates the constraints is passed with no flips and a=0
+    //(used by the waste-recycling estimators, which weight both the current and the proposed state)
+    template<class Observer> void Move(int nflips,Observer && observer){
+        
+        if(mtm_>1){
+            MoveMultipleTry(nflips);
+            return;
+        }
         
         //Picking "nflips" random spins to be flipped
-        if(RandSpin(flips_,nflips)){
+        if(!RandSpin(flips_,nflips)){
+            observer(state_,noflips_,0.);
+        }
+        else{
             
             //Computing acceptance probability
-            double acceptance=std::norm(wf_.PoP(state_,flips_));
+            //the accuracy of the ratio depends on the tier selected in the wave-function
+            double acceptance=wf_.AcceptRatio(state_,flips_)*hastings_;
+            
+            observer(state_,flips_,std::min(1.,acceptance));
             
             //Metropolis-Hastings test  测试MH算法  SM--s11附近
             if(acceptance>Uniform()){
@@ -171,9 +382,70 @@ public:
                 wf_.UpdateLt(state_,flips_);
                 
                 //Moving to the new configuration  转到新的configuration
-                for(const auto& flip : flips_){
-                    state_[flip]*=-1;
+                FlipSpins(flips_);
+                
+                accept_+=1;
+            }
+        }
+        
+        nmoves_+=1;
+    }
+    
+    //Multiple-try Metropolis move
+    //mtm_ candidates y_k are proposed and y_j is selected with probability proportional to |Psi(y_j)|^2,
+    //then mtm_-1 reference states x*_k are proposed from y_j, and x*_mtm=x is the current state
+    //the move is accepted with probability min(1, sum_k |Psi(y_k)|^2 / sum_k |Psi(x*_k)|^2 )
+    //proposals that would violate the constraint on the magnetization are treated as proposals of the current state
+    void MoveMultipleTry(int nflips){
+        
+        for(int k=0;k<mtm_;k++){
+            if(!RandSpin(cands_[k],nflips)){
+                cands_[k].clear();
+            }
+        }
+        
+        //all the candidates are evaluated in a single pass over the weights
+        wf_.LogPoPMulti(state_,std::vector<int>(),cands_,logcands_);
+        
+        double wsum=0;
+        for(int k=0;k<mtm_;k++){
+            wcands_[k]=std::exp(2.*logcands_[k].real());
+            wsum+=wcands_[k];
+        }
+        
+        //selection of the candidate
+        double r=Uniform()*wsum;
+        int sel=0;
+        while(sel<mtm_-1 && r>=wcands_[sel]){
+            r-=wcands_[sel];
+            sel++;
+        }
+        
+        const std::vector<int> & flipsel=cands_[sel];
+        
+        if(flipsel.size()>0){
+            
+            //reference states, drawn from the selected candidate
+            FlipSpins(flipsel);
+            for(int k=0;k<mtm_-1;k++){
+                if(!RandSpin(refs_[k],nflips)){
+                    refs_[k].clear();
                 }
+            }
+            FlipSpins(flipsel);
+            
+            wf_.LogPoPMulti(state_,flipsel,refs_,logrefs_);
+            
+            //the current state has weight 1 relative to itself
+            double wrefs=1.;
+            for(int k=0;k<mtm_-1;k++){
+                wrefs+=std::exp(2.*logrefs_[k].real())*wcands_[sel];
+            }
+            
+            if(wsum>Uniform()*wrefs){
+                wf_.UpdateLt(state_,flipsel);
+                
+                FlipSpins(flipsel);
                 
                 accept_+=1;
             }
@@ -182,6 +454,45 @@ public:
         nmoves_+=1;
     }
     
+    //Prepares the sampling: random initial state, sets of spins and look-up tables
+    void Init(int nflips){
+        InitRandomState();
+        
+        //with two spin flips only exchanges of antiparallel spins are proposed
+        InitSpinSets(nflips==2);
+        
+        flips_.resize(nflips);
+        
+        //initializing look-up tables in the wave-function
+        wf_.InitLt(state_);   //state最开始的入口
+        
+        ResetAv();
+    }
+    
+    //One sweep, made of nspins*sweepfactor moves
+    inline void Sweep(int nflips,int sweepfactor=1){
+        for(int i=0;i<nspins_*sweepfactor;i++){
+            Move(nflips);
+        }
+    }
+    
+    //One sweep of nspins moves, with the proposals passed to the observer (see Move)
+    //not available with multiple-try moves, whose proposals are not single candidates
+    template<class Observer> void ObservedSweep(int nflips,Observer && observer){
+        if(mtm_>1){
+            std::cerr<<"# Error : The proposals of multiple-try Metropolis moves cannot be observed"<<std::endl;
+            std::abort();
+        }
+        for(int i=0;i<nspins_;i++){
+            Move(nflips,observer);
+        }
+    }
+    
+    //current state in the sampling
+    inline const std::vector<int> & State()const{
+        return state_;
+    }
+    
     void SetFileStates(std::string filename){
         writestates_=true;
         filestates_.open(filename.c_str());
@@ -204,6 +515,11 @@ public:
     //Measuring the value of the local energy  在当前状态测量能量的值
     //on the current state
     void MeasureEnergy(){
+        energy_.push_back(LocalEnergy());
+    }
+    
+    //Value of the local energy on the current state
+    std::complex<double> LocalEnergy(){
         std::complex<double> en=0.;
         
         //Finds the non-zero matrix elements of the hamiltonian
@@ -212,17 +528,67 @@ public:
         //state' is encoded as the sequence of spin flips to be performed on state
         hamiltonian_.FindConn(state_,flipsh_,mel_);
         
-        for(int i=0;i<flipsh_.size();i++){
+        for(int i=0;i<int(flipsh_.size());i++){
             en+=wf_.PoP(state_,flipsh_[i])*mel_[i];
         }
         
-        energy_.push_back(en);
+        return en;
+    }
+    
+    //Thermalization with automatic detection of equilibrium
+    //the local energy is recorded after each sweep, and every "checksweeps" sweeps the trace is tested with Equilibrated
+    //at most maxsweeps sweeps are performed, if the equilibrium is not detected within them Thermalized() is false
+    //returns the number of thermalization sweeps done
+    int Thermalize(double maxsweeps,int sweepfactor,int nflips,int checksweeps=20,double rhatmax=1.05){
+        std::vector<double> trace;
+        
+        thermalized_=false;
+        
+        for(double n=0;n<maxsweeps;n+=1){
+            Sweep(nflips,sweepfactor);
+            trace.push_back(LocalEnergy().real());
+            
+            const int ntrace=trace.size();
+            if(ntrace>=2*checksweeps && ntrace%checksweeps==0 && Equilibrated(trace,rhatmax)){
+                thermalized_=true;
+                return ntrace;
+            }
+        }
+        
+        return trace.size();
+    }
+    
+    bool Thermalized()const{
+        return thermalized_;
+    }
+    
+    //Initial equilibration of the chain, from a random state:
+    //nsweeps*thermfactor sweeps, or automatic thermalization with at most nsweeps sweeps if thermfactor=-1
+    //returns the number of thermalization sweeps done
+    int Equilibrate(double nsweeps,double thermfactor,int nflips){
+        Init(nflips);
+        
+        if(thermfactor<0){
+            const int ntherm=Thermalize(nsweeps,1,nflips);
+            if(!thermalized_){
+                std::cerr<<"# Warning : equilibrium was not detected within "<<ntherm<<" thermalization sweeps (chain "<<chain_<<")"<<std::endl;
+            }
+            return ntherm;
+        }
+        
+        int ntherm=0;
+        for(double n=0;n<nsweeps*thermfactor;n+=1){
+            Sweep(nflips);
+            ntherm++;
+        }
+        return ntherm;
     }
     
     
     //Run the Monte Carlo sampling
     //nsweeps is the total number of sweeps to be done
     //thermfactor is the fraction of nsweeps to be discarded during the initial equilibration
+    //if thermfactor=-1 the equilibration is detected automatically (at most nsweeps sweeps are discarded)
     //sweepfactor set the number of single spin flips per sweeps to nspins*sweepfactor
     //nflipss is the number of random spin flips to be done, it is automatically set to 1 or 2 depending on the hamiltonian
     //运行蒙特卡罗采样
@@ -230,7 +596,7 @@ public:
        // thermfactor是在初始平衡期间要丢弃的nsweeps的分数
        // sweepfactor将每次扫描的单个自旋翻转次数设置为nspins * sweepfactor
        // nflipss是要完成的随机旋转翻转次数，根据汉密尔顿函数自动设置为1或2
-    void Run(double nsweeps,double thermfactor=0.1,int sweepfactor=1,int nflipss=-1){  //后面三个参数都是默认设置
+    void Run(double nsweeps,double thermfactor=-1,int sweepfactor=1,int nflipss=-1){  //后面三个参数都是默认设置
         
         int nflips=nflipss;
         
@@ -244,8 +610,8 @@ public:
             std::cerr<<std::endl;
             std::abort();
         }
-        if(thermfactor>1 || thermfactor<0){  //热化因子应该在0和1之间
-            std::cerr<<"# Error : The thermalization factor should be a real number between 0 and 1";
+        if(thermfactor>1 || (thermfactor<0 && thermfactor!=-1)){  //热化因子应该在0和1之间
+            std::cerr<<"# Error : The thermalization factor should be a real number between 0 and 1 (or -1 for automatic thermalization)";
             std::cerr<<std::endl;
             std::abort();
         }
@@ -258,25 +624,28 @@ public:
         std::cout<<"# Starting Monte Carlo sampling"<<std::endl;
         std::cout<<"# Number of sweeps to be performed is "<<nsweeps<<std::endl;
         
-        InitRandomState();
-        
-        flips_.resize(nflips);
-        
-        //initializing look-up tables in the wave-function
-        wf_.InitLt(state_);   //state最开始的入口
-        
-        ResetAv();
+        Init(nflips);
         
         std::cout<<"# Thermalization... ";
         std::flush(std::cout);
         
         //thermalization
-        for(double n=0;n<nsweeps*thermfactor;n+=1){
-            for(int i=0;i<nspins_*sweepfactor;i++){
-                Move(nflips);
+        if(thermfactor<0){
+            int ntherm=Thermalize(nsweeps,sweepfactor,nflips);
+            if(thermalized_){
+                std::cout<<" DONE after "<<ntherm<<" sweeps"<<std::endl;
+            }
+            else{
+                std::cout<<" STOPPED after "<<ntherm<<" sweeps"<<std::endl;
+                std::cerr<<"# Warning : equilibrium was not detected within the maximum number of thermalization sweeps"<<std::endl;
             }
         }
-        std::cout<<" DONE "<<std::endl;
+        else{
+            for(double n=0;n<nsweeps*thermfactor;n+=1){
+                Sweep(nflips,sweepfactor);
+            }
+            std::cout<<" DONE "<<std::endl;
+        }
         std::flush(std::cout);
         
         ResetAv();
@@ -285,15 +654,22 @@ public:
         std::flush(std::cout);
         
         //sequence of sweeps
+        sweeptime_=0;
+        meastime_=0;
         for(double n=0;n<nsweeps;n+=1){
-            for(int i=0;i<nspins_*sweepfactor;i++){
-                Move(nflips);
-            }
+            const auto t0=std::chrono::steady_clock::now();
+            Sweep(nflips,sweepfactor);
+            const auto t1=std::chrono::steady_clock::now();
             if(writestates_){
                 WriteState();
             }
             MeasureEnergy();
+            const auto t2=std::chrono::steady_clock::now();
+            
+            sweeptime_+=std::chrono::duration<double>(t1-t0).count();
+            meastime_+=std::chrono::duration<double>(t2-t1).count();
         }
+        nsweepsdone_=nsweeps;
         std::cout<<" DONE "<<std::endl;
         std::flush(std::cout);
         
@@ -336,6 +712,9 @@ public:
         double estav=enmean/double(nspins_);
         double esterror=std::sqrt(enmeansq/double(nblocks))/double(nspins_);
         
+        estav_=estav;
+        esterror_=esterror;
+        
         int ndigits=std::log10(esterror);
         if(ndigits<0){
             ndigits=-ndigits+2;
@@ -355,4 +734,22 @@ public:
         std::cout<<0.5*double(blocksize)*enmeansq/enmeansq_unblocked<<std::endl;
     }
     
+    //energy per spin estimated in the last run, and its statistical error
+    inline double EnergyPerSpin()const{
+        return estav_;
+    }
+    
+    inline double EnergyError()const{
+        return esterror_;
+    }
+    
+    //throughput of the last run
+    inline double SweepsPerSecond()const{
+        return nsweepsdone_/sweeptime_;
+    }
+    
+    inline double MeasurementsPerSecond()const{
+        return nsweepsdone_/meastime_;
+    }
+    
 };
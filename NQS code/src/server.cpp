@@ -0,0 +1,570 @@
+//
+//  server.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <complex>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "nqs_paper.h"
+
+//Amplitude server: keeps a set of networks in memory and evaluates batches of configurations,
+//avoiding the start-up and parsing cost of a run of nqs_run for each query
+//Requests are read line by line from stdin (with the responses on stdout), or from the clients of a Unix domain socket
+//
+//  load NAME FILE    loads a network from FILE, the rest of the line (a network with the same name is replaced)
+//                    -> ok NAME nv nh
+//  logval NAME N     followed by N lines with a configuration each
+//                    -> ok N, followed by N lines "re im" with log(Psi)
+//  ratio NAME N      followed by N lines "CONFIGURATION f1 f2 ...", with the sites to be flipped
+//                    -> ok N, followed by N lines "re im" with log(Psi(flipped)/Psi)
+//  quit              closes the connection
+//  shutdown          stops the server
+//
+//configurations are strings of nv characters, 1 or + for spin up and 0 or - for spin down
+//invalid requests are answered with a single line "error MESSAGE"
+//the requests of concurrent clients are coalesced, and evaluated together on a pool of threads,
+//with the configurations of logval requests evaluated in blocks by Nqs::LogValBatch
+//log messages are written on stderr
+
+struct AmplitudeRequest{
+    //logval (false) or ratio (true)
+    bool ratio;
+    std::string model;
+    std::vector<std::vector<int> > states;
+    std::vector<std::vector<int> > flips;
+    std::vector<std::complex<double> > results;
+    std::string error;
+    bool done;
+};
+
+//reads lines from a file descriptor
+class LineReader{
+
+    const int fd_;
+    std::string buffer_;
+
+public:
+
+    LineReader(int fd):fd_(fd){}
+
+    //returns false at the end of the input
+    bool ReadLine(std::string & line){
+        while(true){
+            const std::size_t pos=buffer_.find('\n');
+            if(pos!=std::string::npos){
+                line=buffer_.substr(0,pos);
+                buffer_.erase(0,pos+1);
+                if(line.size()>0 && line[line.size()-1]=='\r'){
+                    line.erase(line.size()-1);
+                }
+                return true;
+            }
+
+            char chunk[4096];
+            const ssize_t nread=read(fd_,chunk,sizeof(chunk));
+            if(nread<=0){
+                return false;
+            }
+            buffer_.append(chunk,nread);
+        }
+    }
+};
+
+class AmplitudeServer{
+
+    //number of threads evaluating each batch
+    const int nthreads_;
+
+    //persistent workers evaluating the batches together with the dispatching thread (which is thread 0)
+    //the (request, configuration) pairs of the current batch are divided in contiguous slices, one per thread
+    std::vector<std::thread> workers_;
+    std::vector<std::pair<AmplitudeRequest *,int> > tasks_;
+    std::mutex poolmutex_;
+    std::condition_variable poolcv_;
+    std::condition_variable pooldonecv_;
+    long generation_;
+    int busy_;
+    bool poolstop_;
+
+    //configurations of the logval requests packed as signed bytes for LogValBatch, one buffer per thread
+    std::vector<std::vector<int8_t> > packed_;
+
+    //one copy of each network per thread, since the evaluations use the look-up tables and the scratch space of the network
+    std::map<std::string,std::vector<std::unique_ptr<Nqs> > > models_;
+    std::mutex modelsmutex_;
+
+    //serializes the loads, which redirect std::cout
+    std::mutex loadmutex_;
+
+    //requests waiting for the dispatcher
+    std::vector<AmplitudeRequest *> pending_;
+    std::mutex queuemutex_;
+    std::condition_variable queuecv_;
+    std::condition_variable donecv_;
+    bool dispatching_;
+    bool stopping_;
+
+    //listening socket and connected clients
+    int listenfd_;
+    std::vector<int> clientfds_;
+    std::mutex clientsmutex_;
+
+public:
+
+    AmplitudeServer(int nthreads):nthreads_(std::max(nthreads,1)){
+        dispatching_=false;
+        stopping_=false;
+        listenfd_=-1;
+
+        generation_=0;
+        busy_=0;
+        poolstop_=false;
+        packed_.resize(nthreads_);
+        for(int t=1;t<nthreads_;t++){
+            workers_.push_back(std::thread(&AmplitudeServer::Worker,this,t));
+        }
+    }
+
+    AmplitudeServer(const AmplitudeServer & other)=delete;
+
+    ~AmplitudeServer(){
+        {
+            std::lock_guard<std::mutex> lock(poolmutex_);
+            poolstop_=true;
+        }
+        poolcv_.notify_all();
+        for(auto & worker : workers_){
+            worker.join();
+        }
+    }
+
+    //loads a network, returning the error message if the file cannot be opened or is not a valid network
+    //(the file is checked first, since the loader of Nqs aborts on invalid files)
+    std::string Load(std::string name,std::string filename){
+        if(!std::ifstream(filename.c_str()).good()){
+            return "cannot open file "+filename;
+        }
+        if(!Nqs::ValidParameterFile(filename)){
+            return "invalid network file "+filename;
+        }
+
+        std::lock_guard<std::mutex> loadlock(loadmutex_);
+        std::vector<std::unique_ptr<Nqs> > copies;
+
+        //the messages of the loader are not shown
+        std::ostringstream log;
+        std::streambuf * coutbuf=std::cout.rdbuf(log.rdbuf());
+        copies.push_back(std::unique_ptr<Nqs>(new Nqs(filename)));
+        std::cout.rdbuf(coutbuf);
+
+        for(int t=1;t<nthreads_;t++){
+            copies.push_back(std::unique_ptr<Nqs>(new Nqs(*copies[0])));
+        }
+
+        std::lock_guard<std::mutex> lock(modelsmutex_);
+        models_[name].swap(copies);
+        std::cerr<<"# Network "<<name<<" loaded from file "<<filename<<std::endl;
+        return "";
+    }
+
+    //serves a single client on stdin and stdout
+    void ServeStdio(){
+        std::cerr<<"# Serving requests on stdin"<<std::endl;
+        Session(0,1);
+    }
+
+    //serves the clients connecting to a Unix domain socket, until a shutdown request
+    void ServeSocket(std::string path){
+        std::signal(SIGPIPE,SIG_IGN);
+
+        sockaddr_un addr;
+        std::memset(&addr,0,sizeof(addr));
+        addr.sun_family=AF_UNIX;
+        if(path.size()>=sizeof(addr.sun_path)){
+            std::cerr<<"# Error : Socket path "<<path<<" is too long"<<std::endl;
+            std::abort();
+        }
+        std::strcpy(addr.sun_path,path.c_str());
+
+        listenfd_=socket(AF_UNIX,SOCK_STREAM,0);
+        unlink(path.c_str());
+        if(listenfd_<0 || bind(listenfd_,(sockaddr *)&addr,sizeof(addr))<0 || listen(listenfd_,16)<0){
+            std::cerr<<"# Error : Cannot listen on socket "<<path<<" : "<<std::strerror(errno)<<std::endl;
+            std::abort();
+        }
+        std::cerr<<"# Listening on socket "<<path<<std::endl;
+
+        dispatching_=true;
+        std::thread dispatcher(&AmplitudeServer::Dispatch,this);
+
+        std::vector<std::thread> clients;
+        while(true){
+            const int clientfd=accept(listenfd_,0,0);
+            if(clientfd<0){
+                std::lock_guard<std::mutex> lock(queuemutex_);
+                if(stopping_){
+                    break;
+                }
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(clientsmutex_);
+            clientfds_.push_back(clientfd);
+            clients.push_back(std::thread(&AmplitudeServer::Client,this,clientfd));
+        }
+
+        for(auto & client : clients){
+            client.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queuemutex_);
+            dispatching_=false;
+        }
+        queuecv_.notify_all();
+        dispatcher.join();
+
+        close(listenfd_);
+        unlink(path.c_str());
+        std::cerr<<"# Server stopped"<<std::endl;
+    }
+
+private:
+
+    void Client(int clientfd){
+        const bool shutdown=Session(clientfd,clientfd);
+
+        {
+            std::lock_guard<std::mutex> lock(clientsmutex_);
+            clientfds_.erase(std::find(clientfds_.begin(),clientfds_.end(),clientfd));
+        }
+        close(clientfd);
+
+        if(shutdown){
+            Stop();
+        }
+    }
+
+    //stops accepting clients, and closes the open connections
+    void Stop(){
+        {
+            std::lock_guard<std::mutex> lock(queuemutex_);
+            stopping_=true;
+        }
+        ::shutdown(listenfd_,SHUT_RDWR);
+
+        std::lock_guard<std::mutex> lock(clientsmutex_);
+        for(const auto & fd : clientfds_){
+            ::shutdown(fd,SHUT_RDWR);
+        }
+    }
+
+    //processes the requests of a client, returns true if the server must be stopped
+    bool Session(int infd,int outfd){
+        LineReader reader(infd);
+        std::string line;
+
+        while(reader.ReadLine(line)){
+            std::istringstream sline(line);
+            std::string command,name;
+            sline>>command;
+
+            if(command.size()==0){
+                continue;
+            }
+            if(command=="quit"){
+                return false;
+            }
+            if(command=="shutdown"){
+                return true;
+            }
+
+            std::ostringstream response;
+            response<<std::setprecision(17);
+
+            if(command=="load"){
+                //the file name is the rest of the line, so that it can contain spaces
+                std::string filename,message;
+                if(sline>>name){
+                    std::getline(sline>>std::ws,filename);
+                    filename.erase(filename.find_last_not_of(" \t")+1);
+                }
+                if(filename.size()==0){
+                    response<<"error usage : load NAME FILE"<<std::endl;
+                }
+                else if((message=Load(name,filename)).size()>0){
+                    response<<"error "<<message<<std::endl;
+                }
+                else{
+                    std::lock_guard<std::mutex> lock(modelsmutex_);
+                    const Nqs & wf=*models_[name][0];
+                    response<<"ok "<<name<<" "<<wf.Nspins()<<" "<<wf.Nhidden()<<std::endl;
+                }
+            }
+            else if(command=="logval" || command=="ratio"){
+                long nconf=-1;
+                sline>>name>>nconf;
+
+                AmplitudeRequest request;
+                request.ratio=(command=="ratio");
+                request.model=name;
+                request.done=false;
+
+                //the configurations are always read, so that the stream stays in sync after an error
+                const int nv=Nspins(name);
+                for(long n=0;n<nconf;n++){
+                    if(!reader.ReadLine(line)){
+                        return false;
+                    }
+                    if(request.error.size()==0){
+                        ParseConfiguration(line,nv,request);
+                    }
+                }
+
+                if(nconf<0){
+                    response<<"error usage : "<<command<<" NAME N"<<std::endl;
+                }
+                else if(nv<0){
+                    response<<"error unknown network "<<name<<std::endl;
+                }
+                else{
+                    if(request.error.size()==0){
+                        Submit(request);
+                    }
+                    if(request.error.size()>0){
+                        response<<"error "<<request.error<<std::endl;
+                    }
+                    else{
+                        response<<"ok "<<nconf<<"\n";
+                        for(const auto & res : request.results){
+                            response<<res.real()<<" "<<res.imag()<<"\n";
+                        }
+                    }
+                }
+            }
+            else{
+                response<<"error unknown command "<<command<<std::endl;
+            }
+
+            if(!WriteAll(outfd,response.str())){
+                return false;
+            }
+        }
+        return false;
+    }
+
+    //number of spins of a network, -1 if it is not loaded
+    int Nspins(std::string name){
+        std::lock_guard<std::mutex> lock(modelsmutex_);
+        auto it=models_.find(name);
+        return (it==models_.end())?-1:it->second[0]->Nspins();
+    }
+
+    //reads a configuration (and the flips, for ratios) appending it to the request
+    static void ParseConfiguration(const std::string & line,int nv,AmplitudeRequest & request){
+        std::istringstream sline(line);
+        std::string conf;
+        sline>>conf;
+
+        if(int(conf.size())!=nv){
+            request.error="configurations must have "+std::to_string(nv)+" spins";
+            return;
+        }
+        std::vector<int> state(nv);
+        for(int v=0;v<nv;v++){
+            if(conf[v]=='1' || conf[v]=='+'){
+                state[v]=1;
+            }
+            else if(conf[v]=='0' || conf[v]=='-'){
+                state[v]=-1;
+            }
+            else{
+                request.error="invalid character in configuration "+conf;
+                return;
+            }
+        }
+        request.states.push_back(state);
+
+        std::vector<int> flips;
+        int flip;
+        while(sline>>flip){
+            if(flip<0 || flip>=nv || std::find(flips.begin(),flips.end(),flip)!=flips.end()){
+                request.error="invalid site "+std::to_string(flip);
+                return;
+            }
+            flips.push_back(flip);
+        }
+        request.flips.push_back(flips);
+    }
+
+    //evaluates a request, together with the ones of the other clients when the dispatcher is running
+    void Submit(AmplitudeRequest & request){
+        if(!dispatching_){
+            std::vector<AmplitudeRequest *> batch(1,&request);
+            ProcessBatch(batch);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(queuemutex_);
+        pending_.push_back(&request);
+        queuecv_.notify_one();
+        donecv_.wait(lock,[&request]{return request.done;});
+    }
+
+    //takes all the pending requests at once, and evaluates them as a single batch
+    void Dispatch(){
+        std::vector<AmplitudeRequest *> batch;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(queuemutex_);
+                queuecv_.wait(lock,[this]{return pending_.size()>0 || !dispatching_;});
+                if(pending_.size()==0){
+                    return;
+                }
+                batch.swap(pending_);
+            }
+
+            ProcessBatch(batch);
+
+            {
+                std::lock_guard<std::mutex> lock(queuemutex_);
+                for(auto & request : batch){
+                    request->done=true;
+                }
+            }
+            donecv_.notify_all();
+            batch.clear();
+        }
+    }
+
+    //the configurations of all the requests are divided in contiguous slices, one for each thread of the pool
+    void ProcessBatch(std::vector<AmplitudeRequest *> & batch){
+        std::lock_guard<std::mutex> lock(modelsmutex_);
+
+        tasks_.clear();
+        for(auto & request : batch){
+            auto it=models_.find(request->model);
+            if(it==models_.end() || (request->states.size()>0 && it->second[0]->Nspins()!=int(request->states[0].size()))){
+                request->error="network "+request->model+" was replaced during the request";
+                continue;
+            }
+            request->results.resize(request->states.size());
+            for(int n=0;n<int(request->states.size());n++){
+                tasks_.push_back(std::make_pair(request,n));
+            }
+        }
+
+        if(tasks_.size()==0){
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> poollock(poolmutex_);
+            busy_=nthreads_-1;
+            generation_++;
+        }
+        poolcv_.notify_all();
+
+        ProcessSlice(0);
+
+        std::unique_lock<std::mutex> poollock(poolmutex_);
+        pooldonecv_.wait(poollock,[this]{return busy_==0;});
+    }
+
+    //waits for the batches, and evaluates its slice of each of them
+    void Worker(int thread){
+        long seen=0;
+        std::unique_lock<std::mutex> lock(poolmutex_);
+        while(true){
+            poolcv_.wait(lock,[this,seen]{return poolstop_ || generation_!=seen;});
+            if(poolstop_){
+                return;
+            }
+            seen=generation_;
+
+            lock.unlock();
+            ProcessSlice(thread);
+            lock.lock();
+
+            busy_--;
+            if(busy_==0){
+                pooldonecv_.notify_one();
+            }
+        }
+    }
+
+    //consecutive configurations of a logval request are evaluated together by LogValBatch,
+    //and consecutive ratios on the same configuration share the initialization of the look-up tables
+    void ProcessSlice(int thread){
+        const int ntasks=tasks_.size();
+        const int begin=(long(ntasks)*thread)/nthreads_;
+        const int end=(long(ntasks)*(thread+1))/nthreads_;
+
+        const Nqs * ltwf=0;
+        const std::vector<int> * ltstate=0;
+
+        for(int i=begin;i<end;i++){
+            AmplitudeRequest & request=*tasks_[i].first;
+            const int n=tasks_[i].second;
+            Nqs & wf=*models_.find(request.model)->second[thread];
+            const std::vector<int> & state=request.states[n];
+
+            if(!request.ratio){
+                int last=i+1;
+                while(last<end && tasks_[last].first==&request){
+                    last++;
+                }
+
+                const int nconf=last-i;
+                const int nv=state.size();
+                std::vector<int8_t> & packed=packed_[thread];
+                packed.resize(long(nconf)*nv);
+                for(int c=0;c<nconf;c++){
+                    std::copy(request.states[n+c].begin(),request.states[n+c].end(),packed.begin()+long(c)*nv);
+                }
+                wf.LogValBatch(&packed[0],nconf,&request.results[n]);
+
+                i=last-1;
+                continue;
+            }
+
+            if(ltwf!=&wf || *ltstate!=state){
+                wf.InitLt(state);
+                ltwf=&wf;
+                ltstate=&state;
+            }
+            request.results[n]=wf.LogPoP(state,request.flips[n]);
+        }
+    }
+
+    static bool WriteAll(int fd,const std::string & data){
+        std::size_t written=0;
+        while(written<data.size()){
+            const ssize_t n=write(fd,data.data()+written,data.size()-written);
+            if(n<=0){
+                return false;
+            }
+            written+=n;
+        }
+        return true;
+    }
+
+};
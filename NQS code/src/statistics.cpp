@@ -0,0 +1,203 @@
+//
+//  statistics.cpp
+//  NQS
+//
+
+#include <vector>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include "nqs_paper.h"
+
+//Simple statistical tools used to analyse Monte Carlo traces
+
+//Mean of the elements [begin,end) of a trace
+inline double TraceMean(const std::vector<double> & trace,int begin,int end){
+    double mean=0;
+    for(int i=begin;i<end;i++){
+        mean+=trace[i];
+    }
+    return mean/double(end-begin);
+}
+
+//MSER (Marginal Standard Error Rule) truncation point of a trace
+//the trace is first reduced to averages over batches of "batch" elements
+//returns the number of elements of the original trace to be discarded,
+//i.e. the d minimizing sum_{i>=d}(x_i-mean_d)^2/(n-d)^2 over the whole trace (at least two batches are kept)
+//a truncation point in the second half of the trace means that the trace is not yet stationary
+int MserTruncation(const std::vector<double> & trace,int batch=5){
+    const int nbatches=trace.size()/batch;
+
+    if(nbatches<4){
+        return trace.size();
+    }
+
+    std::vector<double> x(nbatches);
+    for(int i=0;i<nbatches;i++){
+        x[i]=TraceMean(trace,i*batch,(i+1)*batch);
+    }
+
+    //running sums from the end of the trace
+    double sum=0;
+    double sumsq=0;
+    std::vector<double> mser(nbatches);
+    for(int d=nbatches-1;d>=0;d--){
+        sum+=x[d];
+        sumsq+=x[d]*x[d];
+        const double n=double(nbatches-d);
+        mser[d]=(sumsq-sum*sum/n)/(n*n);
+    }
+
+    int dbest=0;
+    for(int d=1;d<nbatches-1;d++){
+        if(mser[d]<mser[dbest]){
+            dbest=d;
+        }
+    }
+
+    return dbest*batch;
+}
+
+//Gelman-Rubin potential scale reduction factor for a set of chains
+//all chains are truncated to the length of the shortest one
+double GelmanRubin(const std::vector<std::vector<double> > & chains){
+    const int m=chains.size();
+
+    int n=std::numeric_limits<int>::max();
+    for(const auto & chain : chains){
+        n=std::min(n,int(chain.size()));
+    }
+
+    if(m<2 || n<2){
+        return std::numeric_limits<double>::infinity();
+    }
+
+    std::vector<double> means(m);
+    double grandmean=0;
+    double within=0;
+
+    for(int c=0;c<m;c++){
+        means[c]=TraceMean(chains[c],0,n);
+        grandmean+=means[c]/double(m);
+
+        double var=0;
+        for(int i=0;i<n;i++){
+            var+=(chains[c][i]-means[c])*(chains[c][i]-means[c]);
+        }
+        within+=var/double(n-1)/double(m);
+    }
+
+    double between=0;
+    for(int c=0;c<m;c++){
+        between+=(means[c]-grandmean)*(means[c]-grandmean);
+    }
+    between*=double(n)/double(m-1);
+
+    if(within<=0){
+        return (between<=0)?1.:std::numeric_limits<double>::infinity();
+    }
+
+    const double varplus=double(n-1)/double(n)*within+between/double(n);
+    return std::sqrt(varplus/within);
+}
+
+//Split-chain version of the Gelman-Rubin statistic
+//each chain is cut into "nsplit" consecutive segments which are compared as independent chains
+double SplitGelmanRubin(const std::vector<std::vector<double> > & chains,int nsplit=2){
+    std::vector<std::vector<double> > segments;
+
+    for(const auto & chain : chains){
+        const int len=chain.size()/nsplit;
+        for(int s=0;s<nsplit;s++){
+            segments.push_back(std::vector<double>(chain.begin()+s*len,chain.begin()+(s+1)*len));
+        }
+    }
+
+    return GelmanRubin(segments);
+}
+
+//Equilibration test of a trace, used by the automatic thermalization:
+//the MSER truncation point must fall in the first half of the trace,
+//and the part of the trace after it must pass a split-chain Gelman-Rubin test
+bool Equilibrated(const std::vector<double> & trace,double rhatmax=1.05){
+    const int trunc=MserTruncation(trace);
+    if(2*trunc>=int(trace.size())){
+        return false;
+    }
+    std::vector<std::vector<double> > chains(1,std::vector<double>(trace.begin()+trunc,trace.end()));
+    return SplitGelmanRubin(chains,4)<rhatmax;
+}
+
+//Streaming binning analysis of a trace of complex values, in O(maxbins) memory
+//values are averaged in bins; when 2*maxbins bins are full, neighbouring bins are merged and the bin size doubles,
+//so that the number of bins stays between maxbins and 2*maxbins for long traces
+class StreamingBinning{
+
+    int maxbins_;
+
+    long binsize_;
+    long nbin_;
+    std::complex<double> current_;
+    std::vector<std::complex<double> > bins_;
+
+    long n_;
+    std::complex<double> sum_;
+
+public:
+
+    StreamingBinning(int maxbins=32):maxbins_(maxbins){
+        binsize_=1;
+        nbin_=0;
+        current_=0.;
+        n_=0;
+        sum_=0.;
+    }
+
+    void Add(std::complex<double> x){
+        sum_+=x;
+        n_++;
+
+        current_+=x;
+        nbin_++;
+        if(nbin_<binsize_){
+            return;
+        }
+        bins_.push_back(current_/double(binsize_));
+        current_=0.;
+        nbin_=0;
+
+        if(int(bins_.size())==2*maxbins_){
+            for(int b=0;b<maxbins_;b++){
+                bins_[b]=0.5*(bins_[2*b]+bins_[2*b+1]);
+            }
+            bins_.resize(maxbins_);
+            binsize_*=2;
+        }
+    }
+
+    inline long Count()const{
+        return n_;
+    }
+
+    inline std::complex<double> Mean()const{
+        return sum_/double(n_);
+    }
+
+    //error of the mean, from the spread of the full bins
+    double Error()const{
+        const int nbins=bins_.size();
+        if(nbins<2){
+            return std::numeric_limits<double>::infinity();
+        }
+        std::complex<double> mean=0.;
+        for(const auto & b : bins_){
+            mean+=b;
+        }
+        mean/=double(nbins);
+        double var=0;
+        for(const auto & b : bins_){
+            var+=std::norm(b-mean);
+        }
+        return std::sqrt(var/double(nbins-1)/double(nbins));
+    }
+};
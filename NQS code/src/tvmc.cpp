@@ -0,0 +1,296 @@
+//
+//  tvmc.cpp
+//  NQS
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <complex>
+#include <memory>
+#include <thread>
+#include <cmath>
+#include "nqs_paper.h"
+
+//Time-dependent variational Monte Carlo
+//The parameters evolve according to S dp/dt = -i F, where
+//S_kl = <O_k^* O_l> - <O_k^*><O_l> and F_k = <O_k^* E_loc> - <O_k^*><E_loc>
+//are estimated on samples of |Psi|^2, with O_k = d log Psi / d p_k
+//Samples are generated by independent Markov chains running in parallel threads,
+//and the equations of motion are integrated with an adaptive Heun scheme
+template<class Hamiltonian> class Tvmc{
+
+    //wave-function to be evolved
+    Nqs & wf_;
+
+    //number of parallel chains
+    const int nchains_;
+
+    //number of variational parameters
+    const int npar_;
+
+    //number of spin flips of the Monte Carlo moves
+    const int nflips_;
+
+    //each chain has its own copy of the wave-function (with its look-up tables) and of the hamiltonian
+    std::vector<std::unique_ptr<Nqs> > wfs_;
+    std::vector<std::unique_ptr<Hamiltonian> > hams_;
+    std::vector<std::unique_ptr<Sampler<Nqs,Hamiltonian> > > samplers_;
+
+    //log-derivatives (one row per sample) and local energies
+    std::vector<std::complex<double> > O_;
+    std::vector<std::complex<double> > eloc_;
+    int nsamp_;
+
+    //regularization of the S matrix
+    double diagshift_;
+
+    //tolerance on the integration error per parameter, and current time step
+    double tol_;
+    double dt_;
+
+    //energy of the last estimate of the velocity, which can be a trial point of the integrator,
+    //and energy at the current parameters
+    std::complex<double> energy_;
+    std::complex<double> ecurrent_;
+
+public:
+
+    Tvmc(Nqs & wf,Hamiltonian & hamiltonian,int nchains,int seed,double diagshift=1.0e-3,double tol=1.0e-3):
+    wf_(wf),nchains_(nchains),npar_(wf.Npar()),nflips_(hamiltonian.MinFlips()),diagshift_(diagshift),tol_(tol){
+
+        if(nchains_<1){
+            std::cerr<<"# Error : The number of chains should be at least 1"<<std::endl;
+            std::abort();
+        }
+
+        for(int c=0;c<nchains_;c++){
+            wfs_.push_back(std::unique_ptr<Nqs>(new Nqs(wf_)));
+            hams_.push_back(std::unique_ptr<Hamiltonian>(new Hamiltonian(hamiltonian)));
+            samplers_.push_back(std::unique_ptr<Sampler<Nqs,Hamiltonian> >(new Sampler<Nqs,Hamiltonian>(*wfs_[c],*hams_[c],seed,c)));
+        }
+
+        dt_=0.01;
+        nsamp_=0;
+    }
+
+    //Integrates the equations of motion up to time tmax
+    //nsweeps samples are used at each evaluation of the velocity
+    //snapshots are written every dtsave to files prefix.time_t.wf
+    void Run(int nsweeps,double tmax,double dtsave,std::string prefix){
+        std::cout<<"# Starting t-VMC evolution up to time "<<tmax<<" with "<<nchains_<<" chains"<<std::endl;
+
+        nsamp_=nchains_*((nsweeps+nchains_-1)/nchains_);
+        O_.resize(nsamp_*npar_);
+        eloc_.resize(nsamp_);
+
+        ForEachChain([this,nsweeps](int c){
+            samplers_[c]->Init(nflips_);
+            samplers_[c]->Thermalize(nsweeps,1,nflips_);
+        });
+
+        std::vector<std::complex<double> > pars,k1,k2,peuler,pheun;
+        wf_.GetParameters(pars);
+
+        double t=0;
+        double nextsave=dtsave;
+        Save(prefix,t);
+
+        Velocity(pars,k1);
+        ecurrent_=energy_;
+
+        std::cout<<"# time  energy per spin (real, imag)  time step"<<std::endl;
+
+        while(t<tmax-1.0e-12){
+            const double h=std::min(dt_,nextsave-t);
+
+            peuler.resize(npar_);
+            for(int k=0;k<npar_;k++){
+                peuler[k]=pars[k]+h*k1[k];
+            }
+
+            Velocity(peuler,k2);
+
+            pheun.resize(npar_);
+            double err=0;
+            for(int k=0;k<npar_;k++){
+                pheun[k]=pars[k]+0.5*h*(k1[k]+k2[k]);
+                err+=std::norm(pheun[k]-peuler[k]);
+            }
+            err=std::sqrt(err/double(npar_));
+
+            //if the step is rejected, the velocity k1 at the current parameters is reused
+            if(err<=tol_){
+                std::cout<<std::scientific<<std::setprecision(6);
+                std::cout<<t<<"  "<<ecurrent_.real()/double(wf_.Nspins())<<"  "<<ecurrent_.imag()/double(wf_.Nspins())<<"  "<<h<<std::endl;
+
+                pars=pheun;
+                t+=h;
+
+                if(std::abs(t-nextsave)<1.0e-12){
+                    wf_.SetParameters(pars);
+                    Save(prefix,t);
+                    nextsave+=dtsave;
+                }
+
+                Velocity(pars,k1);
+                ecurrent_=energy_;
+            }
+
+            //step size control for a second order scheme
+            const double factor=(err>0)?(0.9*std::sqrt(tol_/err)):2.;
+            dt_=h*std::max(0.2,std::min(2.,factor));
+        }
+
+        wf_.SetParameters(pars);
+    }
+
+    //Estimates the velocity dp/dt for the given parameters
+    void Velocity(const std::vector<std::complex<double> > & pars,std::vector<std::complex<double> > & pdot){
+        Sample(pars);
+
+        //averages
+        std::vector<std::complex<double> > omean(npar_,0.);
+        std::complex<double> emean=0.;
+
+        for(int s=0;s<nsamp_;s++){
+            const std::complex<double> * os=&O_[s*npar_];
+            for(int k=0;k<npar_;k++){
+                omean[k]+=os[k];
+            }
+            emean+=eloc_[s];
+        }
+        for(int k=0;k<npar_;k++){
+            omean[k]/=double(nsamp_);
+        }
+        emean/=double(nsamp_);
+        energy_=emean;
+
+        //centering the log-derivatives and computing the forces
+        std::vector<std::complex<double> > force(npar_,0.);
+        for(int s=0;s<nsamp_;s++){
+            std::complex<double> * os=&O_[s*npar_];
+            const std::complex<double> de=eloc_[s]-emean;
+            for(int k=0;k<npar_;k++){
+                os[k]-=omean[k];
+                force[k]+=std::conj(os[k])*de;
+            }
+        }
+        for(int k=0;k<npar_;k++){
+            force[k]/=double(nsamp_);
+        }
+
+        SolveS(force,pdot);
+
+        for(int k=0;k<npar_;k++){
+            pdot[k]*=std::complex<double>(0.,-1.);
+        }
+    }
+
+    //Solves (S+diagshift) x = b with the conjugate gradient method
+    //S is applied as (1/N) O^dagger O on the centered log-derivatives, without being stored
+    void SolveS(const std::vector<std::complex<double> > & b,std::vector<std::complex<double> > & x,int maxiter=1000,double cgtol=1.0e-8){
+        x.assign(npar_,0.);
+
+        std::vector<std::complex<double> > r(b),p(b),sp(npar_);
+
+        double rr=Norm2(r);
+        const double bb=rr;
+
+        for(int it=0;it<maxiter && rr>cgtol*cgtol*bb;it++){
+            ApplyS(p,sp);
+
+            std::complex<double> psp=0.;
+            for(int k=0;k<npar_;k++){
+                psp+=std::conj(p[k])*sp[k];
+            }
+            const std::complex<double> alpha=rr/psp;
+
+            for(int k=0;k<npar_;k++){
+                x[k]+=alpha*p[k];
+                r[k]-=alpha*sp[k];
+            }
+
+            const double rrnew=Norm2(r);
+            const double beta=rrnew/rr;
+            rr=rrnew;
+
+            for(int k=0;k<npar_;k++){
+                p[k]=r[k]+beta*p[k];
+            }
+        }
+    }
+
+private:
+
+    //Generates nsamp_ samples with the given parameters, the chains run in parallel
+    void Sample(const std::vector<std::complex<double> > & pars){
+        const int nperchain=nsamp_/nchains_;
+
+        ForEachChain([this,nperchain,&pars](int c){
+            Nqs & wf=*wfs_[c];
+            Sampler<Nqs,Hamiltonian> & sampler=*samplers_[c];
+
+            wf.SetParameters(pars);
+            wf.InitLt(sampler.State());
+
+            //short equilibration after the change of parameters
+            for(int n=0;n<5;n++){
+                sampler.Sweep(nflips_);
+            }
+
+            for(int i=0;i<nperchain;i++){
+                const int s=c*nperchain+i;
+                sampler.Sweep(nflips_);
+                wf.DerLog(sampler.State(),&O_[s*npar_]);
+                eloc_[s]=sampler.LocalEnergy();
+            }
+        });
+    }
+
+    //Runs task(c) for all the chains, each on its own thread
+    template<class Task> void ForEachChain(Task task){
+        std::vector<std::thread> threads;
+        for(int c=0;c<nchains_;c++){
+            threads.push_back(std::thread(task,c));
+        }
+        for(auto & thread : threads){
+            thread.join();
+        }
+    }
+
+    //sp = (S+diagshift) p
+    void ApplyS(const std::vector<std::complex<double> > & p,std::vector<std::complex<double> > & sp)const{
+        for(int k=0;k<npar_;k++){
+            sp[k]=diagshift_*p[k];
+        }
+        for(int s=0;s<nsamp_;s++){
+            const std::complex<double> * os=&O_[s*npar_];
+            std::complex<double> op=0.;
+            for(int k=0;k<npar_;k++){
+                op+=os[k]*p[k];
+            }
+            op/=double(nsamp_);
+            for(int k=0;k<npar_;k++){
+                sp[k]+=std::conj(os[k])*op;
+            }
+        }
+    }
+
+    inline double Norm2(const std::vector<std::complex<double> > & v)const{
+        double n=0;
+        for(const auto & x : v){
+            n+=std::norm(x);
+        }
+        return n;
+    }
+
+    void Save(std::string prefix,double t){
+        std::ostringstream filename;
+        filename<<prefix<<".time_"<<std::defaultfloat<<std::setprecision(6)<<t<<".wf";
+        wf_.SaveParameters(filename.str());
+        std::cout<<"# Snapshot at time "<<std::defaultfloat<<t<<" written to "<<filename.str()<<std::endl;
+    }
+
+};
@@ -7,7 +7,10 @@
 #include <random>
 #include <complex>
 #include <vector>
+#include <memory>
+#include <thread>
 #include "rbm.hh"
+#include "okstore.hh"
 
 namespace nqs{
 
@@ -23,15 +26,41 @@ template<class Hamiltonian,class RbmState,class Sampler,class Optimizer> class V
   VectorXd v_;
   vector<vector<int> >  connectors_;
   vector<double> mel_;
-  VectorXd logvaldiffs_;
 
   VectorXd elocs_;
-  MatrixXd Ok_;
   MatrixXd vsamp_;
-  MatrixXd S_;
 
   VectorXd grad_;
 
+  //The samples are divided in a fixed number of chunks, independent of the number of threads
+  //partial sums of the log-derivatives O and of O*(E-eshift) over the samples of a chunk
+  struct Chunk{
+    VectorXd sumo;
+    VectorXd sumoe;
+    double eshift;
+  };
+  vector<Chunk> chunks_;
+  static const int maxchunks_=32;
+
+  //Each thread has its own copies of the Rbm and of the Hamiltonian, since they hold scratch variables
+  //thread 0 is the calling one and works directly on rbm_ and ham_
+  struct Workspace{
+    unique_ptr<RbmState> rbmcopy;
+    unique_ptr<Hamiltonian> hamcopy;
+    RbmState * rbm;
+    Hamiltonian * ham;
+    vector<vector<int> > connectors;
+    vector<double> mel;
+    VectorXd v;
+    VectorXd der;
+  };
+  vector<Workspace> workspaces_;
+  int nthreads_;
+
+  //log-derivatives of the last batch, kept only if requested (e.g. for the Stochastic Reconfiguration)
+  bool storeok_;
+  OkStore okstore_;
+
   double elocmean_;
   int npar_;
 
@@ -48,6 +77,9 @@ public:
     grad_.resize(npar_);  
     opt_.SetNpar(npar_);  
     Iter0_=0;
+    storeok_=false;
+
+    SetThreads(1);
 
   }
 
@@ -61,44 +93,107 @@ public:
     }
   }
 
+  //The gradient <O_k E> - <O_k><E> is accumulated one sample at a time,
+  //without storing the nsamp x npar matrix of the log-derivatives
+  //Chunks of samples are distributed over the threads, and their partial sums are combined
+  //with a tree reduction in a fixed order, so the result does not depend on the number of threads
+  //Local energies are shifted by the first one of each chunk to limit cancellations
   void Gradient(){
     const int nsamp=vsamp_.rows();  
     elocs_.resize(nsamp);  
 
-    Ok_.resize(nsamp,rbm_.Npar()); 
+    const int nchunks=std::max(1,std::min(nsamp,int(maxchunks_)));
+    chunks_.resize(nchunks);
 
-    for(int i=0;i<nsamp;i++){  
-      elocs_(i)=Eloc(vsamp_.row(i)); 
-      Ok_.row(i)=rbm_.DerLog(vsamp_.row(i)); 
+    if(storeok_){
+      okstore_.Resize(nsamp,rbm_.Nvisible(),rbm_.Nhidden());
     }
 
-    elocmean_=elocs_.mean(); 
-
-    Ok_=Ok_.rowwise() - Ok_.colwise().mean();  
+    //the copies of the network are brought up to date
+    if(nthreads_>1){
+      const VectorXd pars=rbm_.GetParameters();
+      for(int t=1;t<nthreads_;t++){
+        workspaces_[t].rbm->SetParameters(pars);
+      }
+    }
 
-    elocs_-=elocmean_*VectorXd::Ones(nsamp);  
+    vector<thread> threads;
+    for(int t=1;t<nthreads_;t++){
+      threads.push_back(thread([this,t,nchunks,nsamp](){
+        for(int c=t;c<nchunks;c+=nthreads_){
+          ProcessChunk(c,nchunks,nsamp,workspaces_[t]);
+        }
+      }));
+    }
+    for(int c=0;c<nchunks;c+=nthreads_){
+      ProcessChunk(c,nchunks,nsamp,workspaces_[0]);
+    }
+    for(auto & th : threads){
+      th.join();
+    }
 
-    grad_=Ok_.transpose()*elocs_/double(nsamp); 
-  }
+    //all the partial sums are referred to the same energy shift
+    const double eshift=chunks_[0].eshift;
+    for(int c=1;c<nchunks;c++){
+      chunks_[c].sumoe+=(chunks_[c].eshift-eshift)*chunks_[c].sumo;
+    }
 
+    //pairwise reduction in a fixed order
+    for(int stride=1;stride<nchunks;stride*=2){
+      for(int c=0;c+stride<nchunks;c+=2*stride){
+        chunks_[c].sumo+=chunks_[c+stride].sumo;
+        chunks_[c].sumoe+=chunks_[c+stride].sumoe;
+      }
+    }
 
-  double Eloc(const VectorXd & v){  
+    elocmean_=elocs_.mean(); 
 
-    ham_.FindConn(v,mel_,connectors_);  
+    if(storeok_){
+      okstore_.Finalize();
+    }
 
-    assert(connectors_.size()==mel_.size());  
+    grad_=(chunks_[0].sumoe-(elocmean_-eshift)*chunks_[0].sumo)/double(nsamp); 
+  }
 
-    logvaldiffs_=(rbm_.LogValDiff(v,connectors_));  
+  //number of threads used to compute the gradient
+  void SetThreads(int nthreads){
+    if(nthreads<1){
+      cerr<<"# Error : The number of threads should be at least 1"<<endl;
+      std::abort();
+    }
+    nthreads_=nthreads;
+
+    workspaces_.clear();
+    workspaces_.resize(nthreads_);
+    for(int t=0;t<nthreads_;t++){
+      Workspace & ws=workspaces_[t];
+      if(t==0){
+        ws.rbm=&rbm_;
+        ws.ham=&ham_;
+      }
+      else{
+        ws.rbmcopy.reset(new RbmState(rbm_));
+        ws.hamcopy.reset(new Hamiltonian(ham_));
+        ws.rbm=ws.rbmcopy.get();
+        ws.ham=ws.hamcopy.get();
+      }
+      ws.v.resize(rbm_.Nvisible());
+      ws.der.resize(npar_);
+    }
+  }
 
-    assert(mel_.size()==logvaldiffs_.size());  
+  //keeps the log-derivatives of each batch in a structure-aware store
+  void SetStoreOk(bool storeok){
+    storeok_=storeok;
+  }
 
-    double eloc=0;  
+  OkStore & Store(){
+    return okstore_;
+  }
 
-    for(int i=0;i<logvaldiffs_.size();i++){  
-      eloc+=mel_[i]*std::exp(0.5*logvaldiffs_(i)); 
-    }
 
-    return eloc;
+  double Eloc(const VectorXd & v){  
+    return Eloc(v,rbm_,ham_,mel_,connectors_);
   }
 
   double ElocMean(){
@@ -166,6 +261,54 @@ public:
       }
     }
   }
+
+private:
+
+  //samples [nsamp*c/nchunks, nsamp*(c+1)/nchunks) are accumulated in chunk c
+  void ProcessChunk(int c,int nchunks,int nsamp,Workspace & ws){
+    const int i0=(long(nsamp)*c)/nchunks;
+    const int i1=(long(nsamp)*(c+1))/nchunks;
+
+    Chunk & chunk=chunks_[c];
+    chunk.sumo.setZero(npar_);
+    chunk.sumoe.setZero(npar_);
+    chunk.eshift=0;
+
+    for(int i=i0;i<i1;i++){
+      ws.v=vsamp_.row(i);
+      elocs_(i)=Eloc(ws.v,*ws.rbm,*ws.ham,ws.mel,ws.connectors);
+      if(i==i0){
+        chunk.eshift=elocs_(i);
+      }
+
+      ws.rbm->DerLog(ws.v,ws.der.data());
+      chunk.sumo+=ws.der;
+      chunk.sumoe+=(elocs_(i)-chunk.eshift)*ws.der;
+
+      if(storeok_){
+        okstore_.SetRow(i,ws.v,ws.der.segment(rbm_.Nvisible(),rbm_.Nhidden()));
+      }
+    }
+  }
+
+  static double Eloc(const VectorXd & v,RbmState & rbm,Hamiltonian & ham,vector<double> & mel,vector<vector<int> > & connectors){
+
+    ham.FindConn(v,mel,connectors);  
+
+    assert(connectors.size()==mel.size());  
+
+    const VectorXd logvaldiffs=rbm.LogValDiff(v,connectors);  
+
+    assert(mel.size()==logvaldiffs.size());  
+
+    double eloc=0;  
+
+    for(int i=0;i<logvaldiffs.size();i++){  
+      eloc+=mel[i]*std::exp(0.5*logvaldiffs(i)); 
+    }
+
+    return eloc;
+  }
 };
 
 